@@ -5,6 +5,18 @@
 */
 
 #include <stdint.h>
+#include <stddef.h>
+#if defined(__AVR__)
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#endif
+// avr-libc has no standard library
+#if defined(__has_include)
+#if __has_include(<type_traits>)
+#include <type_traits>
+#define AFS_HAS_TYPE_TRAITS
+#endif
+#endif
 
 /// @defgroup group-opt-shift Optimised bitwise shifts
 ///
@@ -22,7 +34,14 @@
 ///
 /// If there is no overload for a certain shift, that's because GCC produced decent ASM
 /// in that case.
+///
+/// The shifts are constexpr. If the value being shifted is known at compile time, a
+/// standard shift is used instead so that the compiler can still constant fold it.
 /// 
+/// Define AFS_SIZE_OPTIMIZED to trade a little speed for flash: each shift distance
+/// is then a single out of line routine shared by all call sites, instead of being
+/// inlined at each one.
+///
 /// @note Code is usable on all architectures, but the optimization only applies to AVR-GCC.
 /// Other compilers will see a standard bitwise shift.
 /// @{
@@ -37,16 +56,49 @@
 
 #if defined(AFS_USE_OPTIMIZED_SHIFTS)
 
+/// @cond
+namespace afs_detail {
+
+// A single out of line copy of a shift kernel, shared by all call sites.
+//
+// GCC's interprocedural register allocation (-fipa-ra, on at -Os and -O2+) lets
+// the callers see exactly which registers the kernel uses. So unlike a normal
+// call, only those registers are clobbered.
+//
+// Neither this nor the kernels are static: a template instantiated with an internal
+// linkage function is internal too, giving each translation unit its own copy.
+// With external linkage the copies are COMDAT & the linker keeps just one.
+template <typename T, T (*pShift)(T)>
+__attribute__((noinline)) T shared_shift(T a) {
+    return pShift(a);
+}
+
+// Apply a constant shift kernel: inline, or through shared_shift if AFS_SIZE_OPTIMIZED.
+// Whole byte shifts are a few register moves, which are smaller than the call.
+template <uint8_t b, typename T, T (*pShift)(T)>
+static inline __attribute__((always_inline)) T apply_shift(T a) {
+#if defined(AFS_SIZE_OPTIMIZED)
+    return (b%8U)==0U ? pShift(a) : shared_shift<T, pShift>(a);
+#else
+    return pShift(a);
+#endif
+}
+
+}
+/// @endcond
+
+#endif
+
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-function"
 
-/// @{
-/// @brief bitwise left shift optimised for the specified shift distance
-/// @tparam b Number of bits to shift
-/// @param a value to shift
-/// @return a<<b
+/// @cond
+namespace afs_detail {
+
 template <uint8_t b> 
-static inline uint32_t lshift(uint32_t a) {
+inline uint32_t lshift(uint32_t a) {
     // Template is specialized for shifts of 1-16 bits below.
     static_assert(b>16, "Missing template specialization");
     // This is the default, for shifts of 17 or more bits.
@@ -127,24 +179,24 @@ template <> inline uint32_t lshift<5U>(uint32_t a) {
 
 template <> inline uint32_t lshift<6U>(uint32_t a) {
     asm(
+        "clr     __tmp_reg__\n"
         "lsr     %D0\n"
         "ror     %C0\n"
         "ror     %B0\n"
         "ror     %A0\n"
-        "mov     r18, __zero_reg__\n"
-        "ror     r18\n"
+        "ror     __tmp_reg__\n"
         "lsr     %D0\n"
         "ror     %C0\n"
         "ror     %B0\n"
         "ror     %A0\n"
-        "ror     r18\n"
+        "ror     __tmp_reg__\n"
         "mov     %D0, %C0\n"
         "mov     %C0, %B0\n"
-        "mov     r19, %A0\n"
-        "movw    %A0, r18\n"
-        : "=d" (a) 
+        "mov     %B0, %A0\n"
+        "mov     %A0, __tmp_reg__\n"
+        : "=r" (a) 
         : "0" (a) 
-        : "r18", "r19"
+        : 
     );
 
     return a;
@@ -152,19 +204,19 @@ template <> inline uint32_t lshift<6U>(uint32_t a) {
 
 template <> inline uint32_t lshift<7U>(uint32_t a) {
     asm(
+        "clr     __tmp_reg__\n"
         "lsr     %D0\n"
         "ror     %C0\n"
         "ror     %B0\n"
         "ror     %A0\n"
-        "mov     r18, __zero_reg__\n"
-        "ror     r18\n"
+        "ror     __tmp_reg__\n"
         "mov     %D0, %C0\n"
         "mov     %C0, %B0\n"
-        "mov     r19, %A0\n"
-        "movw    %A0, r18\n"
-        : "=d" (a) 
+        "mov     %B0, %A0\n"
+        "mov     %A0, __tmp_reg__\n"
+        : "=r" (a) 
         : "0" (a) 
-        : "r18", "r19"
+        : 
     );
 
     return a;
@@ -179,7 +231,7 @@ template <> inline uint32_t lshift<9U>(uint32_t a) {
         "mov     %C0, %B0\n"
         "mov     %B0, %A0\n"
         "mov     %A0, __zero_reg__\n"
-        : "=d" (a) 
+        : "=r" (a) 
         : "0" (a) 
         : 
     );
@@ -199,7 +251,7 @@ template <> inline uint32_t lshift<10U>(uint32_t a) {
         "mov     %C0, %B0\n"
         "mov     %B0, %A0\n"
         "mov     %A0, __zero_reg__\n"
-        : "=d" (a) 
+        : "=r" (a) 
         : "0" (a) 
         : 
     );
@@ -222,7 +274,7 @@ template <> inline uint32_t lshift<11U>(uint32_t a) {
         "mov     %C0, %B0\n"
         "mov     %B0, %A0\n"
         "mov     %A0, __zero_reg__\n"
-        : "=d" (a) 
+        : "=r" (a) 
         : "0" (a) 
         : 
     );
@@ -283,21 +335,21 @@ template <> inline uint32_t lshift<13U>(uint32_t a) {
 
 template <> inline uint32_t lshift<14U>(uint32_t a) {
     asm(
-        "movw    r18, %A0\n"
+        "clr     __tmp_reg__\n"
         "lsr     %C0\n"
-        "ror     r19\n"
-        "ror     r18\n"
-        "mov     %B0, __zero_reg__\n"
         "ror     %B0\n"
+        "ror     %A0\n"
+        "ror     __tmp_reg__\n"
         "lsr     %C0\n"
-        "ror     r19\n"
-        "ror     r18\n"
         "ror     %B0\n"
+        "ror     %A0\n"
+        "ror     __tmp_reg__\n"
+        "movw    %C0, %A0\n"
+        "mov     %B0, __tmp_reg__\n"
         "mov     %A0, __zero_reg__\n"
-        "movw    %C0, r18\n"
-        : "=d" (a) 
+        : "=r" (a) 
         : "0" (a) 
-        : "r18", "r19"
+        : 
     );
 
     return a;
@@ -305,44 +357,63 @@ template <> inline uint32_t lshift<14U>(uint32_t a) {
 
 template <> inline uint32_t lshift<15U>(uint32_t a) {
     asm(
-        "movw    r18, %A0\n"
+        "clr     __tmp_reg__\n"
         "lsr     %C0\n"
-        "ror     r19\n"
-        "ror     r18\n"
-        "mov     %B0, __zero_reg__\n"
         "ror     %B0\n"
+        "ror     %A0\n"
+        "ror     __tmp_reg__\n"
+        "movw    %C0, %A0\n"
+        "mov     %B0, __tmp_reg__\n"
         "mov     %A0, __zero_reg__\n"
-        "movw    %C0, r18\n"
-        : "=d" (a) 
+        : "=r" (a) 
         : "0" (a) 
-        : "r18", "r19"
+        : 
     );
 
     return a;
 }
-///@}
+
+}
+/// @endcond
 
 #pragma GCC diagnostic pop
 
-#else
+#endif
+
+/// @{
+/// @brief bitwise left shift optimised for the specified shift distance
+/// @tparam b Number of bits to shift
+/// @param a value to shift
+/// @return a<<b
 template <uint8_t b> 
-static inline uint32_t lshift(uint32_t a) { 
-   return a << b; 
+static inline constexpr uint32_t lshift(uint32_t a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? a << b : afs_detail::apply_shift<b, uint32_t, afs_detail::lshift<b>>(a);
+#else
+    return a << b;
+#endif
 }
+
+template <uint8_t b> 
+static inline constexpr int32_t lshift(int32_t a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? (int32_t)((uint32_t)a << b) : (int32_t)afs_detail::apply_shift<b, uint32_t, afs_detail::lshift<b>>((uint32_t)a);
+#else
+    return (int32_t)((uint32_t)a << b);
 #endif
+}
+///@}
 
 #if defined(AFS_USE_OPTIMIZED_SHIFTS)
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-function"
 
-/// @{
-/// @brief bitwise right shift optimised for the specified shift distance
-/// @tparam b Number of bits to shift
-/// @param a value to shift
-/// @return a<<b
+/// @cond
+namespace afs_detail {
+
 template <uint8_t b> 
-static inline uint32_t rshift(uint32_t a) {
+inline uint32_t rshift(uint32_t a) {
     // Template is specialized for shifts of 1-16 bits below.
     static_assert(b>16, "Missing template specialization");
     // This is the default, for shifts of 17 or more bits.
@@ -380,7 +451,7 @@ template <> inline uint32_t rshift<3U>(uint32_t a) {
         "ror     %C0\n"
         "ror     %B0\n"
         "ror     %A0\n"
-        : "=d" (a) 
+        : "=r" (a) 
         : "0" (a) 
         : 
     );
@@ -442,24 +513,24 @@ template <> inline uint32_t rshift<5U>(uint32_t a) {
 
 template <> inline uint32_t rshift<6U>(uint32_t a) {
     asm(
+        "clr     __tmp_reg__\n"
         "lsl     %A0\n"
         "rol     %B0\n"
         "rol     %C0\n"
         "rol     %D0\n"
-        "mov     r19, __zero_reg__\n"
-        "rol     r19\n"
+        "rol     __tmp_reg__\n"
         "lsl     %A0\n"
         "rol     %B0\n"
         "rol     %C0\n"
         "rol     %D0\n"
-        "rol     r19\n"
+        "rol     __tmp_reg__\n"
         "mov     %A0, %B0\n"
         "mov     %B0, %C0\n"
-        "mov     r18, %D0\n"
-        "movw    %C0, r18\n"
-        : "=d" (a) 
+        "mov     %C0, %D0\n"
+        "mov     %D0, __tmp_reg__\n"
+        : "=r" (a) 
         : "0" (a) 
-        : "r18", "r19"
+        : 
     );
 
     return a;
@@ -467,19 +538,19 @@ template <> inline uint32_t rshift<6U>(uint32_t a) {
 
 template <> inline uint32_t rshift<7U>(uint32_t a) {
     asm(
+        "clr     __tmp_reg__\n"
         "lsl     %A0\n"
         "rol     %B0\n"
         "rol     %C0\n"
         "rol     %D0\n"
-        "mov     r19, __zero_reg__\n"
-        "rol     r19\n"
+        "rol     __tmp_reg__\n"
         "mov     %A0, %B0\n"
         "mov     %B0, %C0\n"
-        "mov     r18, %D0\n"
-        "movw    %C0, r18\n"
-        : "=d" (a) 
+        "mov     %C0, %D0\n"
+        "mov     %D0, __tmp_reg__\n"
+        : "=r" (a) 
         : "0" (a) 
-        : "r18", "r19"
+        : 
     );
 
     return a;
@@ -494,7 +565,7 @@ template <> inline uint32_t rshift<9U>(uint32_t a) {
         "mov     %B0, %C0\n"
         "mov     %C0, %D0\n"
         "mov     %D0, __zero_reg__\n"
-        : "=d" (a) 
+        : "=r" (a) 
         : "0" (a) 
         : 
     );
@@ -514,7 +585,7 @@ template <> inline uint32_t rshift<10U>(uint32_t a) {
         "mov     %B0, %C0\n"
         "mov     %C0, %D0\n"
         "mov     %D0, __zero_reg__\n"
-        : "=d" (a) 
+        : "=r" (a) 
         : "0" (a) 
         : 
     );
@@ -537,7 +608,7 @@ template <> inline uint32_t rshift<11U>(uint32_t a) {
         "mov     %B0, %C0\n"
         "mov     %C0, %D0\n"
         "mov     %D0, __zero_reg__\n"
-        : "=d" (a) 
+        : "=r" (a) 
         : "0" (a) 
         : 
     );
@@ -598,21 +669,21 @@ template <> inline uint32_t rshift<13U>(uint32_t a) {
 
 template <> inline uint32_t rshift<14U>(uint32_t a) {
     asm(
-        "movw    r18, %C0\n"
+        "clr     __tmp_reg__\n"
         "lsl     %B0\n"
-        "rol     r18\n"
-        "rol     r19\n"
-        "mov     %C0, __zero_reg__\n"
         "rol     %C0\n"
+        "rol     %D0\n"
+        "rol     __tmp_reg__\n"
         "lsl     %B0\n"
-        "rol     r18\n"
-        "rol     r19\n"
         "rol     %C0\n"
+        "rol     %D0\n"
+        "rol     __tmp_reg__\n"
+        "movw    %A0, %C0\n"
+        "mov     %C0, __tmp_reg__\n"
         "mov     %D0, __zero_reg__\n"
-        "movw    %A0, r18\n"
-        : "=d" (a) 
+        : "=r" (a) 
         : "0" (a) 
-        : "r18", "r19"
+        : 
     );
 
     return a;
@@ -620,135 +691,4982 @@ template <> inline uint32_t rshift<14U>(uint32_t a) {
 
 template <> inline uint32_t rshift<15U>(uint32_t a) {
     asm(
-        "movw    r18, %C0\n"
+        "clr     __tmp_reg__\n"
         "lsl     %B0\n"
-        "rol     r18\n"
-        "rol     r19\n"
-        "mov     %C0, __zero_reg__\n"
         "rol     %C0\n"
+        "rol     %D0\n"
+        "rol     __tmp_reg__\n"
+        "movw    %A0, %C0\n"
+        "mov     %C0, __tmp_reg__\n"
         "mov     %D0, __zero_reg__\n"
-        "movw    %A0, r18\n"
-        : "=d" (a) 
+        : "=r" (a) 
         : "0" (a) 
-        : "r18", "r19"
+        : 
     );
 
     return a;
 }
 
-///@}
+}
+/// @endcond
 
 #pragma GCC diagnostic pop
 
-#else
-template <uint8_t b> 
-static inline uint32_t rshift(uint32_t a) { 
-    return a >> b; 
-}
 #endif
 
-// These overloads are provided for completeness, but are not optimized.
-// They are primarily to support template code that needs to apply shift
-// to generic integral types
+/// @{
+/// @brief bitwise right shift optimised for the specified shift distance
+/// @tparam b Number of bits to shift
+/// @param a value to shift
+/// @return a>>b
 template <uint8_t b> 
-static inline uint8_t lshift(uint8_t a) {
-    return (uint8_t)(a<<b);
+static inline constexpr uint32_t rshift(uint32_t a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? a >> b : afs_detail::apply_shift<b, uint32_t, afs_detail::rshift<b>>(a);
+#else
+    return a >> b;
+#endif
 }
+///@}
+
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/// @cond
+namespace afs_detail {
+
 template <uint8_t b> 
-static inline uint16_t lshift(uint16_t a) {
-    return (uint16_t)(a<<b);
+inline int32_t rshift(int32_t a) {
+    // Template is specialized for shifts of 1-16 bits below.
+    static_assert(b>16, "Missing template specialization");
+    // This is the default, for shifts of 17 or more bits.
+    // Shift by 16, then by the remaining amount.
+    return rshift<b-16U>(rshift<16>(a));
 }
-template <uint8_t b> 
-static inline uint8_t rshift(uint8_t a) {
-    return (uint8_t)(a>>b);
+
+template <> inline int32_t rshift<1U>(int32_t a) {
+    return a >> 1U;
 }
-template <uint8_t b> 
-static inline uint16_t rshift(uint16_t a) {
-    return (uint16_t)(a>>b);
+template <> inline int32_t rshift<2U>(int32_t a) {
+    return a >> 2U;
+}
+template <> inline int32_t rshift<8U>(int32_t a) {
+    return a >> 8U;
+}
+template <> inline int32_t rshift<16U>(int32_t a) {
+    return a >> 16U;
+}
+template <> inline int32_t rshift<24U>(int32_t a) {
+    return a >> 24U;
 }
 
-#if defined(AFS_RUNTIME_API)
-
-#if defined(AFS_USE_OPTIMIZED_SHIFTS) 
+template <> inline int32_t rshift<3U>(int32_t a) {
+    asm(
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
 
-/// @brief bitwise right shift optimised for the specified shift distance
-/// @param a value to shift
-/// @param b Number of bits to shift
-/// @return a>>b 
-static inline uint32_t rshift(uint32_t a, uint8_t b)
-{
-    switch (b)
-    {
-        case 0: return a;
-        case 1: return rshift<1U>(a);
-        case 2: return rshift<2U>(a);
-        case 3: return rshift<3U>(a);
-        case 4: return rshift<4U>(a);
-        case 5: return rshift<5U>(a);
-        case 6: return rshift<6U>(a);
-        case 7: return rshift<7U>(a);
-        case 8: return rshift<8U>(a);
-        case 9: return rshift<9U>(a);
-        case 10: return rshift<10U>(a);
-        case 11: return rshift<11U>(a);
-        case 12: return rshift<12U>(a);
-        case 13: return rshift<13U>(a);
-        case 14: return rshift<14U>(a);
-        case 15: return rshift<15U>(a);
-        //  Note recursion here.
-        default: return rshift(rshift<16>(a), (uint8_t)(b-UINT8_C(16)));
-    }
+    return a;
 }
 
-/// @brief bitwise left shift optimised for the specified shift distance
-/// @param a value to shift
-/// @param b Number of bits to shift
-/// @return a<<b
-static inline uint32_t lshift(uint32_t a, uint8_t b)
-{
-    switch (b)
-    {
-        case 0: return a;
-        case 1: return lshift<1U>(a);
-        case 2: return lshift<2U>(a);
-        case 3: return lshift<3U>(a);
-        case 4: return lshift<4U>(a);
-        case 5: return lshift<5U>(a);
-        case 6: return lshift<6U>(a);
-        case 7: return lshift<7U>(a);
-        case 8: return lshift<8U>(a);
-        case 9: return lshift<9U>(a);
-        case 10: return lshift<10U>(a);
-        case 11: return lshift<11U>(a);
-        case 12: return lshift<12U>(a);
-        case 13: return lshift<13U>(a);
-        case 14: return lshift<14U>(a);
-        case 15: return lshift<15U>(a);
-        //  Note recursion here.
-        default: return lshift(lshift<16>(a), (uint8_t)(b-UINT8_C(16)));
-    }
+template <> inline int32_t rshift<4U>(int32_t a) {
+    asm(
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
 }
 
-#else
-static inline uint32_t rshift(uint32_t a, uint8_t b) { return a >> b; }
-static inline uint32_t lshift(uint32_t a, uint8_t b) { return a << b; }
-#endif
+template <> inline int32_t rshift<5U>(int32_t a) {
+    asm(
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
 
-// These overloads are provided for completeness, but are not optimized.
-// They are primarily to support template code that needs to apply shift
-// to generic integral types
-static inline uint8_t rshift(uint8_t a, uint8_t b) {
-    return (uint8_t)(a>>b);
-}
-static inline uint16_t rshift(uint16_t a, uint8_t b) {
-    return (uint16_t)(a>>b);
-}
-static inline uint8_t lshift(uint8_t a, uint8_t b) {
-    return (uint8_t)(a<<b);
-}
-static inline uint16_t lshift(uint16_t a, uint8_t b) {
-    return (uint16_t)(a<<b);
+    return a;
 }
 
-#endif
+// Shift right 8 & left 2: the 2 bits that drop out of the low byte
+// are held in the carry & T flags while the bytes are moved.
+template <> inline int32_t rshift<6U>(int32_t a) {
+    asm(
+        "bst     %A0, 6\n"
+        "lsl     %A0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "mov     %C0, %D0\n"
+        "mov     %D0, __zero_reg__\n"
+        "sbrc    %C0, 7\n"
+        "dec     %D0\n"
+        "rol     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        "rol     %D0\n"
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        "rol     %D0\n"
+        "bld     %A0, 0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline int32_t rshift<7U>(int32_t a) {
+    asm(
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        "rol     %D0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "mov     %C0, %D0\n"
+        "sbc     %D0, %D0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline int32_t rshift<9U>(int32_t a) {
+    asm(
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "mov     %C0, %D0\n"
+        "lsl     %D0\n"
+        "sbc     %D0, %D0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline int32_t rshift<10U>(int32_t a) {
+    asm(
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "mov     %C0, %D0\n"
+        "lsl     %D0\n"
+        "sbc     %D0, %D0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline int32_t rshift<11U>(int32_t a) {
+    asm(
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "mov     %C0, %D0\n"
+        "lsl     %D0\n"
+        "sbc     %D0, %D0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline int32_t rshift<12U>(int32_t a) {
+    asm(
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "mov     %C0, %D0\n"
+        "lsl     %D0\n"
+        "sbc     %D0, %D0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+// Shift left 3 into a sign extension byte, then move bytes right by 2.
+template <> inline int32_t rshift<13U>(int32_t a) {
+    uint8_t sign;
+    asm(
+        "lsl     %B0\n"
+        "rol     %C0\n"
+        "rol     %D0\n"
+        "sbc     %1, %1\n"
+        "lsl     %B0\n"
+        "rol     %C0\n"
+        "rol     %D0\n"
+        "rol     %1\n"
+        "lsl     %B0\n"
+        "rol     %C0\n"
+        "rol     %D0\n"
+        "rol     %1\n"
+        "movw    %A0, %C0\n"
+        "mov     %C0, %1\n"
+        "lsl     %1\n"
+        "sbc     %D0, %D0\n"
+        : "=r" (a), "=&r" (sign)
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+// Shift right 16 & left 2: the 2 bits that drop out of the second byte
+// are held in the carry & T flags while the bytes are moved.
+template <> inline int32_t rshift<14U>(int32_t a) {
+    asm(
+        "bst     %B0, 6\n"
+        "lsl     %B0\n"
+        "movw    %A0, %C0\n"
+        "mov     %C0, __zero_reg__\n"
+        "sbrc    %B0, 7\n"
+        "dec     %C0\n"
+        "mov     %D0, %C0\n"
+        "rol     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        "bld     %A0, 0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline int32_t rshift<15U>(int32_t a) {
+    asm(
+        "lsl     %B0\n"
+        "rol     %C0\n"
+        "rol     %D0\n"
+        "movw    %A0, %C0\n"
+        "sbc     %C0, %C0\n"
+        "mov     %D0, %C0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+}
+/// @endcond
+
+#pragma GCC diagnostic pop
+
+#endif
+
+/// @{
+/// @brief arithmetic (sign extending) right shift optimised for the specified shift distance
+/// @tparam b Number of bits to shift
+/// @param a value to shift
+/// @return a>>b
+template <uint8_t b> 
+static inline constexpr int32_t rshift(int32_t a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? a >> b : afs_detail::apply_shift<b, int32_t, afs_detail::rshift<b>>(a);
+#else
+    return a >> b;
+#endif
+}
+///@}
+
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/// @cond
+// 64-bit shifts are built from small kernels that are inlined back to back.
+// The AVR inline asm operand modifiers can only address 4 bytes (%A-%D), so the
+// kernels operate on the two 32-bit halves of the value: %0 is the low half, %1
+// the high half.
+namespace afs_detail {
+
+union uint64_halves_t {
+    uint64_t value;
+    struct {
+        uint32_t lo;
+        uint32_t hi;
+    } half;
+};
+
+// Move the value left by k bytes, zero filling.
+template <uint8_t k> 
+static inline void lshift64_bytes(uint32_t &lo, uint32_t &hi);
+
+template <> inline void lshift64_bytes<0U>(uint32_t &, uint32_t &) {
+}
+
+template <> inline void lshift64_bytes<1U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "mov     %D1, %C1\n"
+        "mov     %C1, %B1\n"
+        "mov     %B1, %A1\n"
+        "mov     %A1, %D0\n"
+        "mov     %D0, %C0\n"
+        "mov     %C0, %B0\n"
+        "mov     %B0, %A0\n"
+        "mov     %A0, __zero_reg__\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+template <> inline void lshift64_bytes<2U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "movw    %C1, %A1\n"
+        "movw    %A1, %C0\n"
+        "movw    %C0, %A0\n"
+        "mov     %A0, __zero_reg__\n"
+        "mov     %B0, __zero_reg__\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+template <> inline void lshift64_bytes<3U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "mov     %D1, %A1\n"
+        "mov     %C1, %D0\n"
+        "mov     %B1, %C0\n"
+        "mov     %A1, %B0\n"
+        "mov     %D0, %A0\n"
+        "mov     %C0, __zero_reg__\n"
+        "mov     %B0, __zero_reg__\n"
+        "mov     %A0, __zero_reg__\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+template <> inline void lshift64_bytes<4U>(uint32_t &lo, uint32_t &hi) {
+    hi = lo;
+    lo = 0U;
+}
+
+// Shift left 1 bit. The low k bytes are known to be zero & are skipped.
+template <uint8_t k> 
+static inline void lshift64_bit(uint32_t &lo, uint32_t &hi);
+
+template <> inline void lshift64_bit<0U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        "rol     %D0\n"
+        "rol     %A1\n"
+        "rol     %B1\n"
+        "rol     %C1\n"
+        "rol     %D1\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+template <> inline void lshift64_bit<1U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "lsl     %B0\n"
+        "rol     %C0\n"
+        "rol     %D0\n"
+        "rol     %A1\n"
+        "rol     %B1\n"
+        "rol     %C1\n"
+        "rol     %D1\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+template <> inline void lshift64_bit<2U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "lsl     %C0\n"
+        "rol     %D0\n"
+        "rol     %A1\n"
+        "rol     %B1\n"
+        "rol     %C1\n"
+        "rol     %D1\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+template <> inline void lshift64_bit<3U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "lsl     %D0\n"
+        "rol     %A1\n"
+        "rol     %B1\n"
+        "rol     %C1\n"
+        "rol     %D1\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+// Shift right 1 bit, capturing the bit shifted out of the bottom in the top
+// of spill. Only the low 8-k bytes are shifted: the caller will then move the
+// value left by k+1 bytes, so the higher bytes would be discarded anyway.
+template <uint8_t k> 
+static inline void lshift64_bit_spill(uint32_t &lo, uint32_t &hi, uint8_t &spill);
+
+template <> inline void lshift64_bit_spill<0U>(uint32_t &lo, uint32_t &hi, uint8_t &spill) {
+    asm(
+        "lsr     %D1\n"
+        "ror     %C1\n"
+        "ror     %B1\n"
+        "ror     %A1\n"
+        "ror     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "ror     %2\n"
+        : "+r" (lo), "+r" (hi), "+r" (spill)
+        : 
+        : 
+    );
+}
+
+template <> inline void lshift64_bit_spill<1U>(uint32_t &lo, uint32_t &hi, uint8_t &spill) {
+    asm(
+        "lsr     %C1\n"
+        "ror     %B1\n"
+        "ror     %A1\n"
+        "ror     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "ror     %2\n"
+        : "+r" (lo), "+r" (hi), "+r" (spill)
+        : 
+        : 
+    );
+}
+
+template <> inline void lshift64_bit_spill<2U>(uint32_t &lo, uint32_t &hi, uint8_t &spill) {
+    asm(
+        "lsr     %B1\n"
+        "ror     %A1\n"
+        "ror     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "ror     %2\n"
+        : "+r" (lo), "+r" (hi), "+r" (spill)
+        : 
+        : 
+    );
+}
+
+template <> inline void lshift64_bit_spill<3U>(uint32_t &lo, uint32_t &hi, uint8_t &spill) {
+    asm(
+        "lsr     %A1\n"
+        "ror     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "ror     %2\n"
+        : "+r" (lo), "+r" (hi), "+r" (spill)
+        : 
+        : 
+    );
+}
+
+template <uint8_t k, uint8_t bits> 
+struct lshift64_bits_t {
+    static inline void shift(uint32_t &lo, uint32_t &hi) {
+        lshift64_bit<k>(lo, hi);
+        lshift64_bits_t<k, bits-1U>::shift(lo, hi);
+    }
+};
+template <uint8_t k> 
+struct lshift64_bits_t<k, 0U> {
+    static inline void shift(uint32_t &, uint32_t &) { }
+};
+
+template <uint8_t k, uint8_t bits> 
+struct lshift64_bits_spill_t {
+    static inline void shift(uint32_t &lo, uint32_t &hi, uint8_t &spill) {
+        lshift64_bit_spill<k>(lo, hi, spill);
+        lshift64_bits_spill_t<k, bits-1U>::shift(lo, hi, spill);
+    }
+};
+template <uint8_t k> 
+struct lshift64_bits_spill_t<k, 0U> {
+    static inline void shift(uint32_t &, uint32_t &, uint8_t &) { }
+};
+
+// Shift left by k bytes and r (0-7) bits.
+template <uint8_t k, uint8_t r, bool overshoot = (r>5U)> 
+struct lshift64_lt32_t {
+    static inline void shift(uint32_t &lo, uint32_t &hi) {
+        lshift64_bytes<k>(lo, hi);
+        lshift64_bits_t<k, r>::shift(lo, hi);
+    }
+};
+// For 6 & 7 bits it's cheaper to shift right 8-r bits, then move one more byte.
+template <uint8_t k, uint8_t r> 
+struct lshift64_lt32_t<k, r, true> {
+    static inline void shift(uint32_t &lo, uint32_t &hi) {
+        uint8_t spill = 0U;
+        lshift64_bits_spill_t<k, 8U-r>::shift(lo, hi, spill);
+        lshift64_bytes<k+1U>(lo, hi);
+        lo = lo | ((uint32_t)spill << (k*8U));
+    }
+};
+
+template <uint8_t b, bool lt32 = (b<32U)> 
+struct lshift64_t {
+    static inline void shift(uint32_t &lo, uint32_t &hi) {
+        lshift64_lt32_t<b/8U, b%8U>::shift(lo, hi);
+    }
+};
+template <uint8_t b> 
+struct lshift64_t<b, false> {
+    static inline void shift(uint32_t &lo, uint32_t &hi) {
+        hi = lshift<b-32U>(lo);
+        lo = 0U;
+    }
+};
+template <> 
+struct lshift64_t<32U, false> {
+    static inline void shift(uint32_t &lo, uint32_t &hi) {
+        lshift64_bytes<4U>(lo, hi);
+    }
+};
+
+// Move the value right by k bytes, zero filling.
+template <uint8_t k> 
+static inline void rshift64_bytes(uint32_t &lo, uint32_t &hi);
+
+template <> inline void rshift64_bytes<0U>(uint32_t &, uint32_t &) {
+}
+
+template <> inline void rshift64_bytes<1U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "mov     %C0, %D0\n"
+        "mov     %D0, %A1\n"
+        "mov     %A1, %B1\n"
+        "mov     %B1, %C1\n"
+        "mov     %C1, %D1\n"
+        "mov     %D1, __zero_reg__\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+template <> inline void rshift64_bytes<2U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "movw    %A0, %C0\n"
+        "movw    %C0, %A1\n"
+        "movw    %A1, %C1\n"
+        "mov     %C1, __zero_reg__\n"
+        "mov     %D1, __zero_reg__\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+template <> inline void rshift64_bytes<3U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "mov     %A0, %D0\n"
+        "mov     %B0, %A1\n"
+        "mov     %C0, %B1\n"
+        "mov     %D0, %C1\n"
+        "mov     %A1, %D1\n"
+        "mov     %B1, __zero_reg__\n"
+        "mov     %C1, __zero_reg__\n"
+        "mov     %D1, __zero_reg__\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+template <> inline void rshift64_bytes<4U>(uint32_t &lo, uint32_t &hi) {
+    lo = hi;
+    hi = 0U;
+}
+
+// Move the value right by k bytes, sign filling.
+template <uint8_t k> 
+static inline void srshift64_bytes(uint32_t &lo, uint32_t &hi);
+
+template <> inline void srshift64_bytes<0U>(uint32_t &, uint32_t &) {
+}
+
+template <> inline void srshift64_bytes<1U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "mov     %C0, %D0\n"
+        "mov     %D0, %A1\n"
+        "mov     %A1, %B1\n"
+        "mov     %B1, %C1\n"
+        "mov     %C1, %D1\n"
+        "lsl     %D1\n"
+        "sbc     %D1, %D1\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+template <> inline void srshift64_bytes<2U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "movw    %A0, %C0\n"
+        "movw    %C0, %A1\n"
+        "movw    %A1, %C1\n"
+        "lsl     %D1\n"
+        "sbc     %D1, %D1\n"
+        "mov     %C1, %D1\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+template <> inline void srshift64_bytes<3U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "mov     %A0, %D0\n"
+        "mov     %B0, %A1\n"
+        "mov     %C0, %B1\n"
+        "mov     %D0, %C1\n"
+        "mov     %A1, %D1\n"
+        "lsl     %D1\n"
+        "sbc     %D1, %D1\n"
+        "mov     %C1, %D1\n"
+        "mov     %B1, %D1\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+template <> inline void srshift64_bytes<4U>(uint32_t &lo, uint32_t &hi) {
+    lo = hi;
+    hi = (uint32_t)((int32_t)hi >> 31U);
+}
+
+// Shift right 1 bit. The high k bytes are known to be zero & are skipped.
+template <uint8_t k> 
+static inline void rshift64_bit(uint32_t &lo, uint32_t &hi);
+
+template <> inline void rshift64_bit<0U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "lsr     %D1\n"
+        "ror     %C1\n"
+        "ror     %B1\n"
+        "ror     %A1\n"
+        "ror     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+template <> inline void rshift64_bit<1U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "lsr     %C1\n"
+        "ror     %B1\n"
+        "ror     %A1\n"
+        "ror     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+template <> inline void rshift64_bit<2U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "lsr     %B1\n"
+        "ror     %A1\n"
+        "ror     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+template <> inline void rshift64_bit<3U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "lsr     %A1\n"
+        "ror     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+// Arithmetic shift right 1 bit. The high k bytes are known to be sign fill & are skipped.
+template <uint8_t k> 
+static inline void srshift64_bit(uint32_t &lo, uint32_t &hi);
+
+template <> inline void srshift64_bit<0U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "asr     %D1\n"
+        "ror     %C1\n"
+        "ror     %B1\n"
+        "ror     %A1\n"
+        "ror     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+template <> inline void srshift64_bit<1U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "asr     %C1\n"
+        "ror     %B1\n"
+        "ror     %A1\n"
+        "ror     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+template <> inline void srshift64_bit<2U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "asr     %B1\n"
+        "ror     %A1\n"
+        "ror     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+template <> inline void srshift64_bit<3U>(uint32_t &lo, uint32_t &hi) {
+    asm(
+        "asr     %A1\n"
+        "ror     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        : "+r" (lo), "+r" (hi)
+        : 
+        : 
+    );
+}
+
+// Shift left 1 bit, capturing the bit shifted out of the top in the bottom
+// of spill. Only the high 8-k bytes are shifted: the caller will then move the
+// value right by k+1 bytes, so the lower bytes would be discarded anyway.
+template <uint8_t k> 
+static inline void rshift64_bit_spill(uint32_t &lo, uint32_t &hi, uint8_t &spill);
+
+template <> inline void rshift64_bit_spill<0U>(uint32_t &lo, uint32_t &hi, uint8_t &spill) {
+    asm(
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        "rol     %D0\n"
+        "rol     %A1\n"
+        "rol     %B1\n"
+        "rol     %C1\n"
+        "rol     %D1\n"
+        "rol     %2\n"
+        : "+r" (lo), "+r" (hi), "+r" (spill)
+        : 
+        : 
+    );
+}
+
+template <> inline void rshift64_bit_spill<1U>(uint32_t &lo, uint32_t &hi, uint8_t &spill) {
+    asm(
+        "lsl     %B0\n"
+        "rol     %C0\n"
+        "rol     %D0\n"
+        "rol     %A1\n"
+        "rol     %B1\n"
+        "rol     %C1\n"
+        "rol     %D1\n"
+        "rol     %2\n"
+        : "+r" (lo), "+r" (hi), "+r" (spill)
+        : 
+        : 
+    );
+}
+
+template <> inline void rshift64_bit_spill<2U>(uint32_t &lo, uint32_t &hi, uint8_t &spill) {
+    asm(
+        "lsl     %C0\n"
+        "rol     %D0\n"
+        "rol     %A1\n"
+        "rol     %B1\n"
+        "rol     %C1\n"
+        "rol     %D1\n"
+        "rol     %2\n"
+        : "+r" (lo), "+r" (hi), "+r" (spill)
+        : 
+        : 
+    );
+}
+
+template <> inline void rshift64_bit_spill<3U>(uint32_t &lo, uint32_t &hi, uint8_t &spill) {
+    asm(
+        "lsl     %D0\n"
+        "rol     %A1\n"
+        "rol     %B1\n"
+        "rol     %C1\n"
+        "rol     %D1\n"
+        "rol     %2\n"
+        : "+r" (lo), "+r" (hi), "+r" (spill)
+        : 
+        : 
+    );
+}
+
+template <uint8_t k, uint8_t bits> 
+struct rshift64_bits_t {
+    static inline void shift(uint32_t &lo, uint32_t &hi) {
+        rshift64_bit<k>(lo, hi);
+        rshift64_bits_t<k, bits-1U>::shift(lo, hi);
+    }
+};
+template <uint8_t k> 
+struct rshift64_bits_t<k, 0U> {
+    static inline void shift(uint32_t &, uint32_t &) { }
+};
+
+template <uint8_t k, uint8_t bits> 
+struct srshift64_bits_t {
+    static inline void shift(uint32_t &lo, uint32_t &hi) {
+        srshift64_bit<k>(lo, hi);
+        srshift64_bits_t<k, bits-1U>::shift(lo, hi);
+    }
+};
+template <uint8_t k> 
+struct srshift64_bits_t<k, 0U> {
+    static inline void shift(uint32_t &, uint32_t &) { }
+};
+
+template <uint8_t k, uint8_t bits> 
+struct rshift64_bits_spill_t {
+    static inline void shift(uint32_t &lo, uint32_t &hi, uint8_t &spill) {
+        rshift64_bit_spill<k>(lo, hi, spill);
+        rshift64_bits_spill_t<k, bits-1U>::shift(lo, hi, spill);
+    }
+};
+template <uint8_t k> 
+struct rshift64_bits_spill_t<k, 0U> {
+    static inline void shift(uint32_t &, uint32_t &, uint8_t &) { }
+};
+
+// Shift right by k bytes and r (0-7) bits.
+template <uint8_t k, uint8_t r, bool overshoot = (r>5U)> 
+struct rshift64_lt32_t {
+    static inline void shift(uint32_t &lo, uint32_t &hi) {
+        rshift64_bytes<k>(lo, hi);
+        rshift64_bits_t<k, r>::shift(lo, hi);
+    }
+};
+// For 6 & 7 bits it's cheaper to shift left 8-r bits, then move one more byte.
+template <uint8_t k, uint8_t r> 
+struct rshift64_lt32_t<k, r, true> {
+    static inline void shift(uint32_t &lo, uint32_t &hi) {
+        uint8_t spill = 0U;
+        rshift64_bits_spill_t<k, 8U-r>::shift(lo, hi, spill);
+        rshift64_bytes<k+1U>(lo, hi);
+        hi = hi | ((uint32_t)spill << ((3U-k)*8U));
+    }
+};
+
+template <uint8_t k, uint8_t r, bool overshoot = (r>5U)> 
+struct srshift64_lt32_t {
+    static inline void shift(uint32_t &lo, uint32_t &hi) {
+        srshift64_bytes<k>(lo, hi);
+        srshift64_bits_t<k, r>::shift(lo, hi);
+    }
+};
+template <uint8_t k, uint8_t r> 
+struct srshift64_lt32_t<k, r, true> {
+    static inline void shift(uint32_t &lo, uint32_t &hi) {
+        // Start with the sign fill: the spilled bits are shifted in below it.
+        uint8_t spill = (uint8_t)((int8_t)(hi >> 24U) >> 7U);
+        rshift64_bits_spill_t<k, 8U-r>::shift(lo, hi, spill);
+        rshift64_bytes<k+1U>(lo, hi);
+        hi = hi | ((uint32_t)(int32_t)(int8_t)spill << ((3U-k)*8U));
+    }
+};
+
+template <uint8_t b, bool lt32 = (b<32U)> 
+struct rshift64_t {
+    static inline void shift(uint32_t &lo, uint32_t &hi) {
+        rshift64_lt32_t<b/8U, b%8U>::shift(lo, hi);
+    }
+    static inline void sshift(uint32_t &lo, uint32_t &hi) {
+        srshift64_lt32_t<b/8U, b%8U>::shift(lo, hi);
+    }
+};
+template <uint8_t b> 
+struct rshift64_t<b, false> {
+    static inline void shift(uint32_t &lo, uint32_t &hi) {
+        lo = rshift<b-32U>(hi);
+        hi = 0U;
+    }
+    static inline void sshift(uint32_t &lo, uint32_t &hi) {
+        lo = (uint32_t)rshift<b-32U>((int32_t)hi);
+        hi = (uint32_t)((int32_t)hi >> 31U);
+    }
+};
+template <> 
+struct rshift64_t<32U, false> {
+    static inline void shift(uint32_t &lo, uint32_t &hi) {
+        rshift64_bytes<4U>(lo, hi);
+    }
+    static inline void sshift(uint32_t &lo, uint32_t &hi) {
+        srshift64_bytes<4U>(lo, hi);
+    }
+};
+
+
+template <uint8_t b> 
+inline uint64_t lshift(uint64_t a) {
+    static_assert(b>0U && b<64U, "Shift distance out of range");
+    afs_detail::uint64_halves_t value;
+    value.value = a;
+    afs_detail::lshift64_t<b>::shift(value.half.lo, value.half.hi);
+    return value.value;
+}
+
+template <uint8_t b> 
+inline uint64_t rshift(uint64_t a) {
+    static_assert(b>0U && b<64U, "Shift distance out of range");
+    afs_detail::uint64_halves_t value;
+    value.value = a;
+    afs_detail::rshift64_t<b>::shift(value.half.lo, value.half.hi);
+    return value.value;
+}
+
+template <uint8_t b> 
+inline int64_t rshift(int64_t a) {
+    static_assert(b>0U && b<64U, "Shift distance out of range");
+    afs_detail::uint64_halves_t value;
+    value.value = (uint64_t)a;
+    afs_detail::rshift64_t<b>::sshift(value.half.lo, value.half.hi);
+    return (int64_t)value.value;
+}
+
+}
+/// @endcond
+
+#pragma GCC diagnostic pop
+
+#endif
+
+/// @{
+/// @brief 64-bit bitwise left shift optimised for the specified shift distance
+/// @tparam b Number of bits to shift (1-63)
+/// @param a value to shift
+/// @return a<<b
+template <uint8_t b> 
+static inline constexpr uint64_t lshift(uint64_t a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? a << b : afs_detail::apply_shift<b, uint64_t, afs_detail::lshift<b>>(a);
+#else
+    return a << b;
+#endif
+}
+
+template <uint8_t b> 
+static inline constexpr int64_t lshift(int64_t a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? (int64_t)((uint64_t)a << b) : (int64_t)afs_detail::apply_shift<b, uint64_t, afs_detail::lshift<b>>((uint64_t)a);
+#else
+    return (int64_t)((uint64_t)a << b);
+#endif
+}
+///@}
+
+/// @{
+/// @brief 64-bit bitwise right shift optimised for the specified shift distance
+/// @tparam b Number of bits to shift (1-63)
+/// @param a value to shift
+/// @return a>>b
+template <uint8_t b> 
+static inline constexpr uint64_t rshift(uint64_t a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? a >> b : afs_detail::apply_shift<b, uint64_t, afs_detail::rshift<b>>(a);
+#else
+    return a >> b;
+#endif
+}
+
+template <uint8_t b> 
+static inline constexpr int64_t rshift(int64_t a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? a >> b : afs_detail::apply_shift<b, int64_t, afs_detail::rshift<b>>(a);
+#else
+    return a >> b;
+#endif
+}
+///@}
+
+#if defined(__UINT24_MAX__)
+
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/// @cond
+namespace afs_detail {
+
+template <uint8_t b> 
+inline __uint24 lshift(__uint24 a) {
+    // Template is specialized for shifts of 1-16 bits below.
+    static_assert(b>16 && b<24, "Missing template specialization");
+    // This is the default, for shifts of 17 or more bits: only the low byte
+    // survives.
+    return (__uint24)(uint8_t)((uint8_t)a << (b-16U)) << 16U;
+}
+
+template <> inline __uint24 lshift<1U>(__uint24 a) {
+    return a << 1U;
+}
+template <> inline __uint24 lshift<2U>(__uint24 a) {
+    return a << 2U;
+}
+template <> inline __uint24 lshift<8U>(__uint24 a) {
+    return a << 8U;
+}
+template <> inline __uint24 lshift<16U>(__uint24 a) {
+    return a << 16U;
+}
+
+template <> inline __uint24 lshift<3U>(__uint24 a) {
+    asm(
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 lshift<4U>(__uint24 a) {
+    asm(
+        "swap    %C0\n"
+        "andi    %C0, 240\n"
+        "swap    %B0\n"
+        "eor     %C0, %B0\n"
+        "andi    %B0, 240\n"
+        "eor     %C0, %B0\n"
+        "swap    %A0\n"
+        "eor     %B0, %A0\n"
+        "andi    %A0, 240\n"
+        "eor     %B0, %A0\n"
+        : "=d" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 lshift<5U>(__uint24 a) {
+    asm(
+        "swap    %C0\n"
+        "andi    %C0, 240\n"
+        "swap    %B0\n"
+        "eor     %C0, %B0\n"
+        "andi    %B0, 240\n"
+        "eor     %C0, %B0\n"
+        "swap    %A0\n"
+        "eor     %B0, %A0\n"
+        "andi    %A0, 240\n"
+        "eor     %B0, %A0\n"
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        : "=d" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 lshift<6U>(__uint24 a) {
+    asm(
+        "mov     __tmp_reg__, __zero_reg__\n"
+        "lsr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "ror     __tmp_reg__\n"
+        "lsr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "ror     __tmp_reg__\n"
+        "mov     %C0, %B0\n"
+        "mov     %B0, %A0\n"
+        "mov     %A0, __tmp_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 lshift<7U>(__uint24 a) {
+    asm(
+        "lsr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "mov     %C0, %B0\n"
+        "mov     %B0, %A0\n"
+        "mov     %A0, __zero_reg__\n"
+        "ror     %A0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 lshift<9U>(__uint24 a) {
+    asm(
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "mov     %C0, %B0\n"
+        "mov     %B0, %A0\n"
+        "mov     %A0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 lshift<10U>(__uint24 a) {
+    asm(
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "mov     %C0, %B0\n"
+        "mov     %B0, %A0\n"
+        "mov     %A0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 lshift<11U>(__uint24 a) {
+    asm(
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "mov     %C0, %B0\n"
+        "mov     %B0, %A0\n"
+        "mov     %A0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 lshift<12U>(__uint24 a) {
+    asm(
+        "swap    %B0\n"
+        "andi    %B0, 240\n"
+        "swap    %A0\n"
+        "eor     %B0, %A0\n"
+        "andi    %A0, 240\n"
+        "eor     %B0, %A0\n"
+        "mov     %C0, %B0\n"
+        "mov     %B0, %A0\n"
+        "mov     %A0, __zero_reg__\n"
+        : "=d" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 lshift<13U>(__uint24 a) {
+    asm(
+        "swap    %B0\n"
+        "andi    %B0, 240\n"
+        "swap    %A0\n"
+        "eor     %B0, %A0\n"
+        "andi    %A0, 240\n"
+        "eor     %B0, %A0\n"
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "mov     %C0, %B0\n"
+        "mov     %B0, %A0\n"
+        "mov     %A0, __zero_reg__\n"
+        : "=d" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 lshift<14U>(__uint24 a) {
+    asm(
+        "mov     __tmp_reg__, __zero_reg__\n"
+        "lsr     %B0\n"
+        "ror     %A0\n"
+        "ror     __tmp_reg__\n"
+        "lsr     %B0\n"
+        "ror     %A0\n"
+        "ror     __tmp_reg__\n"
+        "mov     %C0, %A0\n"
+        "mov     %B0, __tmp_reg__\n"
+        "mov     %A0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 lshift<15U>(__uint24 a) {
+    asm(
+        "lsr     %B0\n"
+        "ror     %A0\n"
+        "mov     %C0, %A0\n"
+        "mov     %B0, __zero_reg__\n"
+        "ror     %B0\n"
+        "mov     %A0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <uint8_t b> 
+inline __uint24 rshift(__uint24 a) {
+    // Template is specialized for shifts of 1-16 bits below.
+    static_assert(b>16 && b<24, "Missing template specialization");
+    // This is the default, for shifts of 17 or more bits: only the high byte
+    // survives.
+    return (uint8_t)(a >> 16U) >> (b-16U);
+}
+
+template <> inline __uint24 rshift<1U>(__uint24 a) {
+    return a >> 1U;
+}
+template <> inline __uint24 rshift<2U>(__uint24 a) {
+    return a >> 2U;
+}
+template <> inline __uint24 rshift<8U>(__uint24 a) {
+    return a >> 8U;
+}
+template <> inline __uint24 rshift<16U>(__uint24 a) {
+    return a >> 16U;
+}
+
+template <> inline __uint24 rshift<3U>(__uint24 a) {
+    asm(
+        "lsr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "lsr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "lsr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 rshift<4U>(__uint24 a) {
+    asm(
+        "swap    %A0\n"
+        "andi    %A0, 15\n"
+        "swap    %B0\n"
+        "eor     %A0, %B0\n"
+        "andi    %B0, 15\n"
+        "eor     %A0, %B0\n"
+        "swap    %C0\n"
+        "eor     %B0, %C0\n"
+        "andi    %C0, 15\n"
+        "eor     %B0, %C0\n"
+        : "=d" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 rshift<5U>(__uint24 a) {
+    asm(
+        "swap    %A0\n"
+        "andi    %A0, 15\n"
+        "swap    %B0\n"
+        "eor     %A0, %B0\n"
+        "andi    %B0, 15\n"
+        "eor     %A0, %B0\n"
+        "swap    %C0\n"
+        "eor     %B0, %C0\n"
+        "andi    %C0, 15\n"
+        "eor     %B0, %C0\n"
+        "lsr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        : "=d" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 rshift<6U>(__uint24 a) {
+    asm(
+        "mov     __tmp_reg__, __zero_reg__\n"
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        "rol     __tmp_reg__\n"
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        "rol     __tmp_reg__\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "mov     %C0, __tmp_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 rshift<7U>(__uint24 a) {
+    asm(
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "mov     %C0, __zero_reg__\n"
+        "rol     %C0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 rshift<9U>(__uint24 a) {
+    asm(
+        "lsr     %C0\n"
+        "ror     %B0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "mov     %C0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 rshift<10U>(__uint24 a) {
+    asm(
+        "lsr     %C0\n"
+        "ror     %B0\n"
+        "lsr     %C0\n"
+        "ror     %B0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "mov     %C0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 rshift<11U>(__uint24 a) {
+    asm(
+        "lsr     %C0\n"
+        "ror     %B0\n"
+        "lsr     %C0\n"
+        "ror     %B0\n"
+        "lsr     %C0\n"
+        "ror     %B0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "mov     %C0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 rshift<12U>(__uint24 a) {
+    asm(
+        "swap    %B0\n"
+        "andi    %B0, 15\n"
+        "swap    %C0\n"
+        "eor     %B0, %C0\n"
+        "andi    %C0, 15\n"
+        "eor     %B0, %C0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "mov     %C0, __zero_reg__\n"
+        : "=d" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 rshift<13U>(__uint24 a) {
+    asm(
+        "swap    %B0\n"
+        "andi    %B0, 15\n"
+        "swap    %C0\n"
+        "eor     %B0, %C0\n"
+        "andi    %C0, 15\n"
+        "eor     %B0, %C0\n"
+        "lsr     %C0\n"
+        "ror     %B0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "mov     %C0, __zero_reg__\n"
+        : "=d" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 rshift<14U>(__uint24 a) {
+    asm(
+        "mov     __tmp_reg__, __zero_reg__\n"
+        "lsl     %B0\n"
+        "rol     %C0\n"
+        "rol     __tmp_reg__\n"
+        "lsl     %B0\n"
+        "rol     %C0\n"
+        "rol     __tmp_reg__\n"
+        "mov     %A0, %C0\n"
+        "mov     %B0, __tmp_reg__\n"
+        "mov     %C0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __uint24 rshift<15U>(__uint24 a) {
+    asm(
+        "lsl     %B0\n"
+        "rol     %C0\n"
+        "mov     %A0, %C0\n"
+        "mov     %B0, __zero_reg__\n"
+        "rol     %B0\n"
+        "mov     %C0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <uint8_t b> 
+inline __int24 rshift(__int24 a) {
+    // Template is specialized for shifts of 1-16 bits below.
+    static_assert(b>16 && b<24, "Missing template specialization");
+    // This is the default, for shifts of 17 or more bits: only the high byte
+    // survives.
+    return (int8_t)(a >> 16U) >> (b-16U);
+}
+
+template <> inline __int24 rshift<1U>(__int24 a) {
+    return a >> 1U;
+}
+template <> inline __int24 rshift<2U>(__int24 a) {
+    return a >> 2U;
+}
+template <> inline __int24 rshift<8U>(__int24 a) {
+    return a >> 8U;
+}
+template <> inline __int24 rshift<16U>(__int24 a) {
+    return a >> 16U;
+}
+
+template <> inline __int24 rshift<3U>(__int24 a) {
+    asm(
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __int24 rshift<4U>(__int24 a) {
+    asm(
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __int24 rshift<5U>(__int24 a) {
+    asm(
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __int24 rshift<6U>(__int24 a) {
+    asm(
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        "sbc     __tmp_reg__, __tmp_reg__\n"
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        "rol     __tmp_reg__\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "mov     %C0, __tmp_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __int24 rshift<7U>(__int24 a) {
+    asm(
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "sbc     %C0, %C0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __int24 rshift<9U>(__int24 a) {
+    asm(
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "lsl     %C0\n"
+        "sbc     %C0, %C0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __int24 rshift<10U>(__int24 a) {
+    asm(
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "lsl     %C0\n"
+        "sbc     %C0, %C0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __int24 rshift<11U>(__int24 a) {
+    asm(
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "lsl     %C0\n"
+        "sbc     %C0, %C0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __int24 rshift<12U>(__int24 a) {
+    asm(
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "asr     %C0\n"
+        "ror     %B0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "lsl     %C0\n"
+        "sbc     %C0, %C0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __int24 rshift<13U>(__int24 a) {
+    asm(
+        "lsl     %B0\n"
+        "rol     %C0\n"
+        "sbc     __tmp_reg__, __tmp_reg__\n"
+        "lsl     %B0\n"
+        "rol     %C0\n"
+        "rol     __tmp_reg__\n"
+        "lsl     %B0\n"
+        "rol     %C0\n"
+        "rol     __tmp_reg__\n"
+        "mov     %A0, %C0\n"
+        "mov     %B0, __tmp_reg__\n"
+        "lsl     __tmp_reg__\n"
+        "sbc     %C0, %C0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __int24 rshift<14U>(__int24 a) {
+    asm(
+        "lsl     %B0\n"
+        "rol     %C0\n"
+        "sbc     __tmp_reg__, __tmp_reg__\n"
+        "lsl     %B0\n"
+        "rol     %C0\n"
+        "rol     __tmp_reg__\n"
+        "mov     %A0, %C0\n"
+        "mov     %B0, __tmp_reg__\n"
+        "lsl     __tmp_reg__\n"
+        "sbc     %C0, %C0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline __int24 rshift<15U>(__int24 a) {
+    asm(
+        "lsl     %B0\n"
+        "rol     %C0\n"
+        "mov     %A0, %C0\n"
+        "sbc     %B0, %B0\n"
+        "mov     %C0, %B0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+}
+/// @endcond
+
+#pragma GCC diagnostic pop
+
+#endif
+
+/// @{
+/// @brief 24-bit bitwise left shift optimised for the specified shift distance
+/// @tparam b Number of bits to shift
+/// @param a value to shift
+/// @return a<<b
+template <uint8_t b> 
+static inline constexpr __uint24 lshift(__uint24 a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? a << b : afs_detail::apply_shift<b, __uint24, afs_detail::lshift<b>>(a);
+#else
+    return a << b;
+#endif
+}
+
+template <uint8_t b> 
+static inline constexpr __int24 lshift(__int24 a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? (__int24)((__uint24)a << b) : (__int24)afs_detail::apply_shift<b, __uint24, afs_detail::lshift<b>>((__uint24)a);
+#else
+    return (__int24)((__uint24)a << b);
+#endif
+}
+///@}
+
+/// @{
+/// @brief 24-bit bitwise right shift optimised for the specified shift distance
+/// @tparam b Number of bits to shift
+/// @param a value to shift
+/// @return a>>b
+template <uint8_t b> 
+static inline constexpr __uint24 rshift(__uint24 a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? a >> b : afs_detail::apply_shift<b, __uint24, afs_detail::rshift<b>>(a);
+#else
+    return a >> b;
+#endif
+}
+///@}
+
+/// @{
+/// @brief 24-bit arithmetic (sign extending) right shift optimised for the specified shift distance
+/// @tparam b Number of bits to shift
+/// @param a value to shift
+/// @return a>>b
+template <uint8_t b> 
+static inline constexpr __int24 rshift(__int24 a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? a >> b : afs_detail::apply_shift<b, __int24, afs_detail::rshift<b>>(a);
+#else
+    return a >> b;
+#endif
+}
+///@}
+
+#endif
+
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/// @cond
+namespace afs_detail {
+
+template <uint8_t b> 
+inline uint16_t lshift(uint16_t a) {
+    // Template is fully specialized below.
+    static_assert(b>0 && b<16, "Missing template specialization");
+    return a;
+}
+
+template <> inline uint16_t lshift<1U>(uint16_t a) {
+    return (uint16_t)(a << 1U);
+}
+template <> inline uint16_t lshift<2U>(uint16_t a) {
+    return (uint16_t)(a << 2U);
+}
+template <> inline uint16_t lshift<8U>(uint16_t a) {
+    return (uint16_t)(a << 8U);
+}
+
+template <> inline uint16_t lshift<3U>(uint16_t a) {
+    asm(
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t lshift<4U>(uint16_t a) {
+    asm(
+        "swap    %B0\n"
+        "andi    %B0, 240\n"
+        "swap    %A0\n"
+        "eor     %B0, %A0\n"
+        "andi    %A0, 240\n"
+        "eor     %B0, %A0\n"
+        : "=d" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t lshift<5U>(uint16_t a) {
+    asm(
+        "swap    %B0\n"
+        "andi    %B0, 240\n"
+        "swap    %A0\n"
+        "eor     %B0, %A0\n"
+        "andi    %A0, 240\n"
+        "eor     %B0, %A0\n"
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        : "=d" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t lshift<6U>(uint16_t a) {
+    asm(
+        "mov     __tmp_reg__, __zero_reg__\n"
+        "lsr     %B0\n"
+        "ror     %A0\n"
+        "ror     __tmp_reg__\n"
+        "lsr     %B0\n"
+        "ror     %A0\n"
+        "ror     __tmp_reg__\n"
+        "mov     %B0, %A0\n"
+        "mov     %A0, __tmp_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t lshift<7U>(uint16_t a) {
+    asm(
+        "lsr     %B0\n"
+        "ror     %A0\n"
+        "mov     %B0, %A0\n"
+        "mov     %A0, __zero_reg__\n"
+        "ror     %A0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t lshift<9U>(uint16_t a) {
+    asm(
+        "lsl     %A0\n"
+        "mov     %B0, %A0\n"
+        "mov     %A0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t lshift<10U>(uint16_t a) {
+    asm(
+        "lsl     %A0\n"
+        "lsl     %A0\n"
+        "mov     %B0, %A0\n"
+        "mov     %A0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t lshift<11U>(uint16_t a) {
+    asm(
+        "lsl     %A0\n"
+        "lsl     %A0\n"
+        "lsl     %A0\n"
+        "mov     %B0, %A0\n"
+        "mov     %A0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t lshift<12U>(uint16_t a) {
+    asm(
+        "swap    %A0\n"
+        "andi    %A0, 240\n"
+        "mov     %B0, %A0\n"
+        "mov     %A0, __zero_reg__\n"
+        : "=d" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t lshift<13U>(uint16_t a) {
+    asm(
+        "swap    %A0\n"
+        "andi    %A0, 240\n"
+        "lsl     %A0\n"
+        "mov     %B0, %A0\n"
+        "mov     %A0, __zero_reg__\n"
+        : "=d" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t lshift<14U>(uint16_t a) {
+    asm(
+        "swap    %A0\n"
+        "andi    %A0, 240\n"
+        "lsl     %A0\n"
+        "lsl     %A0\n"
+        "mov     %B0, %A0\n"
+        "mov     %A0, __zero_reg__\n"
+        : "=d" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t lshift<15U>(uint16_t a) {
+    asm(
+        "lsr     %A0\n"
+        "mov     %B0, __zero_reg__\n"
+        "ror     %B0\n"
+        "mov     %A0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <uint8_t b> 
+inline uint16_t rshift(uint16_t a) {
+    // Template is fully specialized below.
+    static_assert(b>0 && b<16, "Missing template specialization");
+    return a;
+}
+
+template <> inline uint16_t rshift<1U>(uint16_t a) {
+    return (uint16_t)(a >> 1U);
+}
+template <> inline uint16_t rshift<2U>(uint16_t a) {
+    return (uint16_t)(a >> 2U);
+}
+template <> inline uint16_t rshift<8U>(uint16_t a) {
+    return (uint16_t)(a >> 8U);
+}
+
+template <> inline uint16_t rshift<3U>(uint16_t a) {
+    asm(
+        "lsr     %B0\n"
+        "ror     %A0\n"
+        "lsr     %B0\n"
+        "ror     %A0\n"
+        "lsr     %B0\n"
+        "ror     %A0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t rshift<4U>(uint16_t a) {
+    asm(
+        "swap    %A0\n"
+        "andi    %A0, 15\n"
+        "swap    %B0\n"
+        "eor     %A0, %B0\n"
+        "andi    %B0, 15\n"
+        "eor     %A0, %B0\n"
+        : "=d" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t rshift<5U>(uint16_t a) {
+    asm(
+        "swap    %A0\n"
+        "andi    %A0, 15\n"
+        "swap    %B0\n"
+        "eor     %A0, %B0\n"
+        "andi    %B0, 15\n"
+        "eor     %A0, %B0\n"
+        "lsr     %B0\n"
+        "ror     %A0\n"
+        : "=d" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t rshift<6U>(uint16_t a) {
+    asm(
+        "mov     __tmp_reg__, __zero_reg__\n"
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     __tmp_reg__\n"
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     __tmp_reg__\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, __tmp_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t rshift<7U>(uint16_t a) {
+    asm(
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, __zero_reg__\n"
+        "rol     %B0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t rshift<9U>(uint16_t a) {
+    asm(
+        "lsr     %B0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t rshift<10U>(uint16_t a) {
+    asm(
+        "lsr     %B0\n"
+        "lsr     %B0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t rshift<11U>(uint16_t a) {
+    asm(
+        "lsr     %B0\n"
+        "lsr     %B0\n"
+        "lsr     %B0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t rshift<12U>(uint16_t a) {
+    asm(
+        "swap    %B0\n"
+        "andi    %B0, 15\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, __zero_reg__\n"
+        : "=d" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t rshift<13U>(uint16_t a) {
+    asm(
+        "swap    %B0\n"
+        "andi    %B0, 15\n"
+        "lsr     %B0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, __zero_reg__\n"
+        : "=d" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t rshift<14U>(uint16_t a) {
+    asm(
+        "swap    %B0\n"
+        "andi    %B0, 15\n"
+        "lsr     %B0\n"
+        "lsr     %B0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, __zero_reg__\n"
+        : "=d" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint16_t rshift<15U>(uint16_t a) {
+    asm(
+        "lsl     %B0\n"
+        "mov     %A0, __zero_reg__\n"
+        "rol     %A0\n"
+        "mov     %B0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <uint8_t b> 
+inline int16_t rshift(int16_t a) {
+    // Template is fully specialized below.
+    static_assert(b>0 && b<16, "Missing template specialization");
+    return a;
+}
+
+template <> inline int16_t rshift<1U>(int16_t a) {
+    return (int16_t)(a >> 1U);
+}
+template <> inline int16_t rshift<2U>(int16_t a) {
+    return (int16_t)(a >> 2U);
+}
+template <> inline int16_t rshift<8U>(int16_t a) {
+    return (int16_t)(a >> 8U);
+}
+
+template <> inline int16_t rshift<3U>(int16_t a) {
+    asm(
+        "asr     %B0\n"
+        "ror     %A0\n"
+        "asr     %B0\n"
+        "ror     %A0\n"
+        "asr     %B0\n"
+        "ror     %A0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline int16_t rshift<4U>(int16_t a) {
+    asm(
+        "asr     %B0\n"
+        "ror     %A0\n"
+        "asr     %B0\n"
+        "ror     %A0\n"
+        "asr     %B0\n"
+        "ror     %A0\n"
+        "asr     %B0\n"
+        "ror     %A0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline int16_t rshift<5U>(int16_t a) {
+    asm(
+        "asr     %B0\n"
+        "ror     %A0\n"
+        "asr     %B0\n"
+        "ror     %A0\n"
+        "asr     %B0\n"
+        "ror     %A0\n"
+        "asr     %B0\n"
+        "ror     %A0\n"
+        "asr     %B0\n"
+        "ror     %A0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline int16_t rshift<6U>(int16_t a) {
+    asm(
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "sbc     __tmp_reg__, __tmp_reg__\n"
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     __tmp_reg__\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, __tmp_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline int16_t rshift<7U>(int16_t a) {
+    asm(
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "mov     %A0, %B0\n"
+        "sbc     %B0, %B0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline int16_t rshift<9U>(int16_t a) {
+    asm(
+        "mov     %A0, %B0\n"
+        "asr     %A0\n"
+        "lsl     %B0\n"
+        "sbc     %B0, %B0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline int16_t rshift<10U>(int16_t a) {
+    asm(
+        "mov     %A0, %B0\n"
+        "asr     %A0\n"
+        "asr     %A0\n"
+        "lsl     %B0\n"
+        "sbc     %B0, %B0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline int16_t rshift<11U>(int16_t a) {
+    asm(
+        "mov     %A0, %B0\n"
+        "asr     %A0\n"
+        "asr     %A0\n"
+        "asr     %A0\n"
+        "lsl     %B0\n"
+        "sbc     %B0, %B0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline int16_t rshift<12U>(int16_t a) {
+    asm(
+        "mov     %A0, %B0\n"
+        "asr     %A0\n"
+        "asr     %A0\n"
+        "asr     %A0\n"
+        "asr     %A0\n"
+        "lsl     %B0\n"
+        "sbc     %B0, %B0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+// Shift the top 3 bits into a sign filled byte.
+template <> inline int16_t rshift<13U>(int16_t a) {
+    asm(
+        "lsl     %B0\n"
+        "sbc     %A0, %A0\n"
+        "lsl     %B0\n"
+        "rol     %A0\n"
+        "lsl     %B0\n"
+        "rol     %A0\n"
+        "sbc     %B0, %B0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline int16_t rshift<14U>(int16_t a) {
+    asm(
+        "lsl     %B0\n"
+        "sbc     %A0, %A0\n"
+        "lsl     %B0\n"
+        "rol     %A0\n"
+        "sbc     %B0, %B0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline int16_t rshift<15U>(int16_t a) {
+    asm(
+        "lsl     %B0\n"
+        "sbc     %A0, %A0\n"
+        "mov     %B0, %A0\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+}
+/// @endcond
+
+#pragma GCC diagnostic pop
+
+#endif
+
+/// @{
+/// @brief 16-bit bitwise left shift optimised for the specified shift distance
+/// @tparam b Number of bits to shift
+/// @param a value to shift
+/// @return a<<b
+template <uint8_t b> 
+static inline constexpr uint16_t lshift(uint16_t a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? (uint16_t)(a << b) : afs_detail::apply_shift<b, uint16_t, afs_detail::lshift<b>>(a);
+#else
+    return (uint16_t)(a << b);
+#endif
+}
+
+template <uint8_t b> 
+static inline constexpr int16_t lshift(int16_t a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? (int16_t)((uint16_t)a << b) : (int16_t)afs_detail::apply_shift<b, uint16_t, afs_detail::lshift<b>>((uint16_t)a);
+#else
+    return (int16_t)((uint16_t)a << b);
+#endif
+}
+///@}
+
+/// @{
+/// @brief 16-bit bitwise right shift optimised for the specified shift distance
+/// @tparam b Number of bits to shift
+/// @param a value to shift
+/// @return a>>b
+template <uint8_t b> 
+static inline constexpr uint16_t rshift(uint16_t a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? (uint16_t)(a >> b) : afs_detail::apply_shift<b, uint16_t, afs_detail::rshift<b>>(a);
+#else
+    return (uint16_t)(a >> b);
+#endif
+}
+///@}
+
+/// @{
+/// @brief 16-bit arithmetic (sign extending) right shift optimised for the specified shift distance
+/// @tparam b Number of bits to shift
+/// @param a value to shift
+/// @return a>>b
+template <uint8_t b> 
+static inline constexpr int16_t rshift(int16_t a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? (int16_t)(a >> b) : afs_detail::apply_shift<b, int16_t, afs_detail::rshift<b>>(a);
+#else
+    return (int16_t)(a >> b);
+#endif
+}
+///@}
+
+// These overloads are provided for completeness, but are not optimized.
+// They are primarily to support template code that needs to apply shift
+// to generic integral types
+template <uint8_t b> 
+static inline constexpr uint8_t lshift(uint8_t a) {
+    return (uint8_t)(a<<b);
+}
+template <uint8_t b> 
+static inline constexpr uint8_t rshift(uint8_t a) {
+    return (uint8_t)(a>>b);
+}
+
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/// @cond
+// Rotates are a whole byte rotation (register moves), then at most 4 single
+// bit rotates in either direction: E.g. rotl<7> is rotl<8> then rotr<1>.
+namespace afs_detail {
+
+template <uint8_t bytes> 
+static inline uint32_t rotl_bytes(uint32_t a) {
+    static_assert(bytes<4, "Missing template specialization");
+    return a;
+}
+
+template <> inline uint32_t rotl_bytes<1U>(uint32_t a) {
+    asm(
+        "mov     __tmp_reg__, %D0\n"
+        "mov     %D0, %C0\n"
+        "mov     %C0, %B0\n"
+        "mov     %B0, %A0\n"
+        "mov     %A0, __tmp_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint32_t rotl_bytes<2U>(uint32_t a) {
+    asm(
+        "mov     __tmp_reg__, %A0\n"
+        "mov     %A0, %C0\n"
+        "mov     %C0, __tmp_reg__\n"
+        "mov     __tmp_reg__, %B0\n"
+        "mov     %B0, %D0\n"
+        "mov     %D0, __tmp_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <> inline uint32_t rotl_bytes<3U>(uint32_t a) {
+    asm(
+        "mov     __tmp_reg__, %A0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "mov     %C0, %D0\n"
+        "mov     %D0, __tmp_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+static inline uint32_t rotl_bit(uint32_t a) {
+    asm(
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        "rol     %D0\n"
+        "adc     %A0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+static inline uint32_t rotr_bit(uint32_t a) {
+    asm(
+        "bst     %A0, 0\n"
+        "lsr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "bld     %D0, 7\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <uint8_t bytes> 
+static inline uint16_t rotl_bytes(uint16_t a) {
+    static_assert(bytes<2, "Missing template specialization");
+    return a;
+}
+
+template <> inline uint16_t rotl_bytes<1U>(uint16_t a) {
+    asm(
+        "mov     __tmp_reg__, %A0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, __tmp_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+static inline uint16_t rotl_bit(uint16_t a) {
+    asm(
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "adc     %A0, __zero_reg__\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+static inline uint16_t rotr_bit(uint16_t a) {
+    asm(
+        "bst     %A0, 0\n"
+        "lsr     %B0\n"
+        "ror     %A0\n"
+        "bld     %B0, 7\n"
+        : "=r" (a) 
+        : "0" (a) 
+        : 
+    );
+
+    return a;
+}
+
+template <uint8_t bits, typename T> 
+struct rotate_bits_t {
+    static inline T left(T a) { return rotate_bits_t<bits-1U, T>::left(rotl_bit(a)); }
+    static inline T right(T a) { return rotate_bits_t<bits-1U, T>::right(rotr_bit(a)); }
+};
+
+template <typename T> 
+struct rotate_bits_t<0U, T> {
+    static inline T left(T a) { return a; }
+    static inline T right(T a) { return a; }
+};
+
+// b is the rotate distance, already reduced modulo the width of T
+template <uint8_t b, typename T, bool leftBits = (b%8U)<5U> 
+struct rotl_t {
+    static inline T rotate(T a) {
+        return rotate_bits_t<b%8U, T>::left(rotl_bytes<b/8U>(a));
+    }
+};
+
+template <uint8_t b, typename T> 
+struct rotl_t<b, T, false> {
+    static inline T rotate(T a) {
+        return rotate_bits_t<8U-(b%8U), T>::right(rotl_bytes<(b/8U+1U)%sizeof(T)>(a));
+    }
+};
+
+template <uint8_t b> 
+inline uint32_t rotl(uint32_t a) {
+    return rotl_t<b, uint32_t>::rotate(a);
+}
+
+template <uint8_t b> 
+inline uint16_t rotl(uint16_t a) {
+    return rotl_t<b, uint16_t>::rotate(a);
+}
+
+}
+/// @endcond
+
+#pragma GCC diagnostic pop
+
+#endif
+
+/// @{
+/// @brief bitwise left rotate optimised for the specified distance
+/// @tparam b Number of bits to rotate. Taken modulo 32.
+/// @param a value to rotate
+/// @return (a<<b) | (a>>(32-b))
+template <uint8_t b> 
+static inline constexpr uint32_t rotl(uint32_t a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? (a << (b%32U)) | (a >> ((32U-b)%32U)) : afs_detail::apply_shift<b%32U, uint32_t, afs_detail::rotl<b%32U>>(a);
+#else
+    return (a << (b%32U)) | (a >> ((32U-b)%32U));
+#endif
+}
+///@}
+
+/// @{
+/// @brief bitwise right rotate optimised for the specified distance
+/// @tparam b Number of bits to rotate. Taken modulo 32.
+/// @param a value to rotate
+/// @return (a>>b) | (a<<(32-b))
+template <uint8_t b> 
+static inline constexpr uint32_t rotr(uint32_t a) {
+    return rotl<(uint8_t)((32U-b)%32U)>(a);
+}
+///@}
+
+/// @{
+/// @brief 16-bit bitwise left rotate optimised for the specified distance
+/// @tparam b Number of bits to rotate. Taken modulo 16.
+/// @param a value to rotate
+/// @return (a<<b) | (a>>(16-b))
+template <uint8_t b> 
+static inline constexpr uint16_t rotl(uint16_t a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? (uint16_t)((a << (b%16U)) | (a >> ((16U-b)%16U))) : afs_detail::apply_shift<b%16U, uint16_t, afs_detail::rotl<b%16U>>(a);
+#else
+    return (uint16_t)((a << (b%16U)) | (a >> ((16U-b)%16U)));
+#endif
+}
+///@}
+
+/// @{
+/// @brief 16-bit bitwise right rotate optimised for the specified distance
+/// @tparam b Number of bits to rotate. Taken modulo 16.
+/// @param a value to rotate
+/// @return (a>>b) | (a<<(16-b))
+template <uint8_t b> 
+static inline constexpr uint16_t rotr(uint16_t a) {
+    return rotl<(uint8_t)((16U-b)%16U)>(a);
+}
+///@}
+
+/// @cond
+namespace afs_detail {
+
+// The narrowest unsigned type with at least this many bytes
+template <uint8_t bytes> 
+struct uint_bytes_t { typedef uint32_t type; };
+template <> 
+struct uint_bytes_t<1U> { typedef uint8_t type; };
+template <> 
+struct uint_bytes_t<2U> { typedef uint16_t type; };
+#if defined(__UINT24_MAX__)
+template <> 
+struct uint_bytes_t<3U> { typedef __uint24 type; };
+#endif
+
+// Shift within a bitfield's bytes: the shifts don't support a distance of 0.
+template <uint8_t b> 
+struct field_shift_t {
+    template <typename T>
+    static constexpr T right(T a) { return ::rshift<b>(a); }
+    template <typename T>
+    static constexpr T left(T a) { return ::lshift<b>(a); }
+};
+
+template <> 
+struct field_shift_t<0U> {
+    template <typename T>
+    static constexpr T right(T a) { return a; }
+    template <typename T>
+    static constexpr T left(T a) { return a; }
+};
+
+// A bitfield of len bits, starting at bit pos of a uint32_t.
+//
+// Only the bytes that hold the field are shifted: the byte offset is free (it's
+// just a choice of registers), leaving a shift of 0-7 bits on a narrower type.
+template <uint8_t pos, uint8_t len> 
+struct bitfield_t {
+    static_assert(len>0U && pos+len<=32U, "Bitfield must be within 32 bits");
+
+    typedef typename uint_bytes_t<(uint8_t)((len+7U)/8U)>::type value_t;
+    typedef typename uint_bytes_t<(uint8_t)((pos+len+7U)/8U - pos/8U)>::type span_t;
+    typedef field_shift_t<pos%8U> shift_t;
+
+    static constexpr uint8_t byte_offset = (uint8_t)((pos/8U)*8U);
+    static constexpr uint32_t value_mask = UINT32_MAX >> (32U-len);
+
+    // The field in the low bits, plus whatever was above it in the same bytes
+    static constexpr span_t shifted(uint32_t a) {
+        return shift_t::right((span_t)(a >> byte_offset));
+    }
+
+    static constexpr value_t extract(uint32_t a) {
+        return (value_t)(shifted(a) & value_mask);
+    }
+
+    template <typename T>
+    static constexpr uint32_t insert(uint32_t dst, T field) {
+        return (dst & ~(value_mask << pos)) 
+             | ((uint32_t)shift_t::left((span_t)(field & value_mask)) << byte_offset);
+    }
+};
+
+}
+/// @endcond
+
+/// @brief Extract a bitfield: (a >> pos) & mask, but only shifting the bytes that hold the field.
+/// @tparam pos Bit position of the field's lowest bit
+/// @tparam len Number of bits in the field. pos+len must be 32 or less.
+/// @param a value containing the field
+/// @return The field, in the narrowest unsigned type that holds len bits
+template <uint8_t pos, uint8_t len> 
+static inline constexpr typename afs_detail::bitfield_t<pos, len>::value_t extract(uint32_t a) {
+    return afs_detail::bitfield_t<pos, len>::extract(a);
+}
+
+/// @brief Insert a bitfield: replace bits pos to pos+len-1 of dst, only shifting the bytes that hold the field.
+/// @tparam pos Bit position of the field's lowest bit
+/// @tparam len Number of bits in the field. pos+len must be 32 or less.
+/// @param dst value to insert the field into
+/// @param field Value of the field. Only the low len bits are used.
+/// @return dst with the field replaced
+template <uint8_t pos, uint8_t len, typename T> 
+static inline constexpr uint32_t insert(uint32_t dst, T field) {
+    return afs_detail::bitfield_t<pos, len>::insert(dst, field);
+}
+
+/// @brief Narrowing bitwise right shift: (TResult)(a>>b), but only the bytes that end up in the result are shifted.
+///
+/// E.g. `rshift<12U, uint16_t>(ticks)` only needs bits 12 to 27: a 4 bit shift of bytes 1-3.
+/// @tparam b Number of bits to shift, 0 to 31
+/// @tparam TResult Result type, E.g. uint16_t or uint8_t
+/// @param a value to shift
+/// @return (TResult)(a>>b)
+template <uint8_t b, typename TResult> 
+static inline constexpr TResult rshift(uint32_t a) {
+    return (TResult)afs_detail::bitfield_t<b, (sizeof(TResult)*8U < 32U-b) ? (uint8_t)(sizeof(TResult)*8U) : (uint8_t)(32U-b)>::shifted(a);
+}
+
+/// @cond
+namespace afs_detail {
+
+// Left shift of a narrower unsigned value into a uint32_t.
+//
+// The result's low b/8 bytes are known to be zero, so the bytes are placed there
+// by register choice. Only the value's bytes, plus one for the bits shifted out
+// of the top (if any), are actually shifted.
+template <uint8_t b, typename T> 
+struct widen_t {
+    static_assert(b<32U, "Shift must be less than 32 bits");
+    static_assert((T)-1>(T)0, "Only unsigned types can be widened");
+
+    static constexpr uint8_t needed_bytes = (uint8_t)(sizeof(T) + ((b%8U)!=0U ? 1U : 0U));
+    static constexpr uint8_t available_bytes = (uint8_t)(4U - b/8U);
+    typedef typename uint_bytes_t<(needed_bytes<available_bytes) ? needed_bytes : available_bytes>::type span_t;
+
+    static constexpr uint32_t lshift(T a) {
+        return (uint32_t)field_shift_t<b%8U>::left((span_t)a) << ((b/8U)*8U);
+    }
+};
+
+}
+/// @endcond
+
+/// @brief Widening bitwise left shift: ((uint32_t)a)<<b, without shifting the known zero upper bytes.
+///
+/// E.g. `lshift<10U, uint32_t>(toothDeltaV)` for a uint16_t toothDeltaV is a 2 bit shift of 3 bytes.
+/// @tparam b Number of bits to shift, 0 to 31
+/// @tparam TResult Result type: must be 32-bit
+/// @param a value to shift: uint8_t, uint16_t or __uint24
+/// @return ((TResult)a)<<b
+template <uint8_t b, typename TResult, typename T> 
+static inline constexpr TResult lshift(T a) {
+    static_assert(sizeof(TResult)==sizeof(uint32_t), "Widening shifts are to 32-bits");
+    return (TResult)afs_detail::widen_t<b, T>::lshift(a);
+}
+
+/// @cond
+namespace afs_detail {
+
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+// (a>>1) + (a&1): the bit shifted out lands in the carry, which is added straight back.
+static inline uint32_t rshift1_round(uint32_t a) {
+    asm(
+        "lsr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "adc     %A0, __zero_reg__\n"
+        "adc     %B0, __zero_reg__\n"
+        "adc     %C0, __zero_reg__\n"
+        "adc     %D0, __zero_reg__\n"
+        : "=r" (a) : "0" (a) :
+    );
+    return a;
+}
+
+static inline int32_t rshift1_round(int32_t a) {
+    asm(
+        "asr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "adc     %A0, __zero_reg__\n"
+        "adc     %B0, __zero_reg__\n"
+        "adc     %C0, __zero_reg__\n"
+        "adc     %D0, __zero_reg__\n"
+        : "=r" (a) : "0" (a) :
+    );
+    return a;
+}
+
+// (a>>b) + bit b-1 of a, which is (a + (1<<(b-1)))>>b without the overflow.
+template <uint8_t b, bool byteAligned = (b%8U==0U)> 
+struct rshift_round_t {
+    template <typename T>
+    static inline T apply(T a) { return rshift1_round(field_shift_t<(uint8_t)(b-1U)>::right(a)); }
+};
+
+// A whole byte shift has no last bit shift to carry the rounding bit: take
+// it from its byte instead.
+template <uint8_t b> 
+struct rshift_round_t<b, true> {
+    static inline uint32_t apply(uint32_t a) { return ::rshift<b>(a) + ::extract<(uint8_t)(b-1U), 1U>(a); }
+    static inline int32_t apply(int32_t a) { return ::rshift<b>(a) + (int32_t)::extract<(uint8_t)(b-1U), 1U>((uint32_t)a); }
+};
+#endif
+
+}
+/// @endcond
+
+/// @{
+/// @brief Rounding right shift: (a + (1<<(b-1))) >> b. I.e. a/2^b rounded to nearest, with halves rounded up.
+///
+/// Calculated without overflow, E.g. `rshift_round<1U>(UINT32_MAX)` is 2^31. The
+/// rounding add is folded into the final bit shift: the bit shifted out is added
+/// straight back from the carry.
+/// @tparam b Number of bits to shift, 1 to 31
+/// @param a value to shift
+/// @return (a>>b) + ((a>>(b-1)) & 1)
+template <uint8_t b> 
+static inline constexpr uint32_t rshift_round(uint32_t a) {
+    static_assert(b>0U && b<32U, "Rounding shifts are 1 to 31 bits");
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? (a >> b) + ((a >> (b-1U)) & 1U) : afs_detail::rshift_round_t<b>::apply(a);
+#else
+    return (a >> b) + ((a >> (b-1U)) & 1U);
+#endif
+}
+
+template <uint8_t b> 
+static inline constexpr int32_t rshift_round(int32_t a) {
+    static_assert(b>0U && b<32U, "Rounding shifts are 1 to 31 bits");
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) ? (a >> b) + ((a >> (b-1U)) & 1) : afs_detail::rshift_round_t<b>::apply(a);
+#else
+    return (a >> b) + ((a >> (b-1U)) & 1);
+#endif
+}
+/// @}
+
+/// @brief Signed division by 2^b, truncating towards zero: a / (1<<b)
+///
+/// GCC biases negative values with branches & then uses its slow shift. Here the
+/// bias (2^b-1 for negative values, else 0) is the sign mask ANDed with a constant.
+/// GCC makes the sign mask (a>>31) in a couple of instructions, so only the final
+/// shift uses the optimized rshift<b>.
+/// @tparam b Number of bits to shift, 1 to 31
+/// @param a value to divide
+/// @return a / 2^b
+template <uint8_t b> 
+static inline constexpr int32_t sdiv_pow2(int32_t a) {
+    static_assert(b>0U && b<32U, "Divisor must be 2^1 to 2^31");
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) 
+        ? (int32_t)((uint32_t)a + ((uint32_t)(a >> 31U) & ((UINT32_C(1) << b) - 1U))) >> b 
+        : rshift<b>((int32_t)((uint32_t)a + ((uint32_t)(a >> 31U) & ((UINT32_C(1) << b) - 1U))));
+#else
+    return (int32_t)((uint32_t)a + ((uint32_t)(a >> 31U) & ((UINT32_C(1) << b) - 1U))) >> b;
+#endif
+}
+
+/// @cond
+namespace afs_detail {
+
+// Would a<<b lose set bits? Tested on the unshifted value against a constant
+// mask, so no shift is needed: bytes wholly inside the mask are just tested for zero.
+template <uint8_t b> 
+static inline constexpr bool lshift_loses_bits(uint32_t a) {
+    return (a & ~(UINT32_MAX >> b)) != 0U;
+}
+
+// Signed: a must be in [-2^(31-b), 2^(31-b)) so that the bits shifted out & the 
+// new sign bit all match the old sign bit. Offsetting a by 2^(31-b) turns that
+// into the unsigned test.
+template <uint8_t b> 
+static inline constexpr bool lshift_loses_bits(int32_t a) {
+    return (((uint32_t)a + (UINT32_C(1) << (31U-b))) & ~(UINT32_MAX >> b)) != 0U;
+}
+
+}
+/// @endcond
+
+/// @{
+/// @brief Saturating left shift: a<<b, clamped to the range of the type instead of wrapping.
+/// @tparam b Number of bits to shift, 1 to 31
+/// @param a value to shift
+/// @return a<<b, or the type's max (min for negative a) if that overflows
+template <uint8_t b> 
+static inline constexpr uint32_t lshift_sat(uint32_t a) {
+    static_assert(b>0U && b<32U, "Saturating shifts are 1 to 31 bits");
+    return afs_detail::lshift_loses_bits<b>(a) ? UINT32_MAX : lshift<b>(a);
+}
+
+template <uint8_t b> 
+static inline constexpr int32_t lshift_sat(int32_t a) {
+    static_assert(b>0U && b<32U, "Saturating shifts are 1 to 31 bits");
+    return afs_detail::lshift_loses_bits<b>(a) ? (a<0 ? INT32_MIN : INT32_MAX) : lshift<b>(a);
+}
+/// @}
+
+/// @{
+/// @brief Overflow checked left shift, in the style of __builtin_mul_overflow.
+/// @tparam b Number of bits to shift, 1 to 31
+/// @param a value to shift
+/// @param result Set to a<<b, wrapped if it overflows
+/// @return true if a<<b overflows
+template <uint8_t b> 
+static inline bool lshift_overflows(uint32_t a, uint32_t &result) {
+    static_assert(b>0U && b<32U, "Checked shifts are 1 to 31 bits");
+    result = lshift<b>(a);
+    return afs_detail::lshift_loses_bits<b>(a);
+}
+
+template <uint8_t b> 
+static inline bool lshift_overflows(int32_t a, int32_t &result) {
+    static_assert(b>0U && b<32U, "Checked shifts are 1 to 31 bits");
+    result = lshift<b>(a);
+    return afs_detail::lshift_loses_bits<b>(a);
+}
+/// @}
+
+/// @cond
+// Shifts that keep the bits shifted out, for multi-precision values. The kernels
+// work on a 64-bit window: carry:a for a left shift, a:carry for a right shift.
+// carry starts as zero, so only the bytes that can hold shifted out bits are touched.
+namespace afs_detail {
+
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+
+// Apply a 1 bit shift kernel count times
+template <void (*pStep)(uint32_t &, uint32_t &), uint8_t count> 
+struct carry_steps_t {
+    static inline void apply(uint32_t &a, uint32_t &carry) {
+        pStep(a, carry);
+        carry_steps_t<pStep, count-1U>::apply(a, carry);
+    }
+};
+template <void (*pStep)(uint32_t &, uint32_t &)> 
+struct carry_steps_t<pStep, 0U> {
+    static inline void apply(uint32_t &, uint32_t &) { }
+};
+
+// Move a left by k bytes, into carry.
+template <uint8_t k> 
+static inline void lshift_carry_bytes(uint32_t &a, uint32_t &carry);
+
+template <> inline void lshift_carry_bytes<0U>(uint32_t &, uint32_t &) {
+}
+
+template <> inline void lshift_carry_bytes<1U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "mov     %A1, %D0\n"
+        "mov     %D0, %C0\n"
+        "mov     %C0, %B0\n"
+        "mov     %B0, %A0\n"
+        "mov     %A0, __zero_reg__\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+template <> inline void lshift_carry_bytes<2U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "movw    %A1, %C0\n"
+        "movw    %C0, %A0\n"
+        "mov     %A0, __zero_reg__\n"
+        "mov     %B0, __zero_reg__\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+template <> inline void lshift_carry_bytes<3U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "mov     %C1, %D0\n"
+        "mov     %B1, %C0\n"
+        "mov     %A1, %B0\n"
+        "mov     %D0, %A0\n"
+        "mov     %C0, __zero_reg__\n"
+        "mov     %B0, __zero_reg__\n"
+        "mov     %A0, __zero_reg__\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+template <> inline void lshift_carry_bytes<4U>(uint32_t &a, uint32_t &carry) {
+    carry = a;
+    a = 0U;
+}
+
+// Shift left 1 bit, after moving k bytes: the low k bytes of a are zero.
+template <uint8_t k> 
+static inline void lshift_carry_bit(uint32_t &a, uint32_t &carry);
+
+template <> inline void lshift_carry_bit<0U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        "rol     %D0\n"
+        "rol     %A1\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+template <> inline void lshift_carry_bit<1U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "lsl     %B0\n"
+        "rol     %C0\n"
+        "rol     %D0\n"
+        "rol     %A1\n"
+        "rol     %B1\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+template <> inline void lshift_carry_bit<2U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "lsl     %C0\n"
+        "rol     %D0\n"
+        "rol     %A1\n"
+        "rol     %B1\n"
+        "rol     %C1\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+template <> inline void lshift_carry_bit<3U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "lsl     %D0\n"
+        "rol     %A1\n"
+        "rol     %B1\n"
+        "rol     %C1\n"
+        "rol     %D1\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+// Shift right 1 bit, after moving k+1 bytes left: for 5-7 bits it's cheaper
+// to overshoot by a byte & come back. Byte k of a is zero & receives the bit.
+template <uint8_t k> 
+static inline void lshift_carry_unbit(uint32_t &a, uint32_t &carry);
+
+template <> inline void lshift_carry_unbit<0U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "lsr     %A1\n"
+        "ror     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+template <> inline void lshift_carry_unbit<1U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "lsr     %B1\n"
+        "ror     %A1\n"
+        "ror     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+template <> inline void lshift_carry_unbit<2U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "lsr     %C1\n"
+        "ror     %B1\n"
+        "ror     %A1\n"
+        "ror     %D0\n"
+        "ror     %C0\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+template <> inline void lshift_carry_unbit<3U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "lsr     %D1\n"
+        "ror     %C1\n"
+        "ror     %B1\n"
+        "ror     %A1\n"
+        "ror     %D0\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+// Shift left by k bytes and r (0-7) bits.
+template <uint8_t k, uint8_t r, bool overshoot = (r>4U)> 
+struct lshift_carry_t {
+    static inline void shift(uint32_t &a, uint32_t &carry) {
+        lshift_carry_bytes<k>(a, carry);
+        carry_steps_t<&lshift_carry_bit<k>, r>::apply(a, carry);
+    }
+};
+template <uint8_t k, uint8_t r> 
+struct lshift_carry_t<k, r, true> {
+    static inline void shift(uint32_t &a, uint32_t &carry) {
+        lshift_carry_bytes<k+1U>(a, carry);
+        carry_steps_t<&lshift_carry_unbit<k>, 8U-r>::apply(a, carry);
+    }
+};
+
+// Move a right by k bytes, into carry.
+template <uint8_t k> 
+static inline void rshift_carry_bytes(uint32_t &a, uint32_t &carry);
+
+template <> inline void rshift_carry_bytes<0U>(uint32_t &, uint32_t &) {
+}
+
+template <> inline void rshift_carry_bytes<1U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "mov     %D1, %A0\n"
+        "mov     %A0, %B0\n"
+        "mov     %B0, %C0\n"
+        "mov     %C0, %D0\n"
+        "mov     %D0, __zero_reg__\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+template <> inline void rshift_carry_bytes<2U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "movw    %C1, %A0\n"
+        "movw    %A0, %C0\n"
+        "mov     %C0, __zero_reg__\n"
+        "mov     %D0, __zero_reg__\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+template <> inline void rshift_carry_bytes<3U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "mov     %B1, %A0\n"
+        "mov     %C1, %B0\n"
+        "mov     %D1, %C0\n"
+        "mov     %A0, %D0\n"
+        "mov     %B0, __zero_reg__\n"
+        "mov     %C0, __zero_reg__\n"
+        "mov     %D0, __zero_reg__\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+template <> inline void rshift_carry_bytes<4U>(uint32_t &a, uint32_t &carry) {
+    carry = a;
+    a = 0U;
+}
+
+// Shift right 1 bit, after moving k bytes: the high k bytes of a are zero.
+template <uint8_t k> 
+static inline void rshift_carry_bit(uint32_t &a, uint32_t &carry);
+
+template <> inline void rshift_carry_bit<0U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "lsr     %D0\n"
+        "ror     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "ror     %D1\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+template <> inline void rshift_carry_bit<1U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "lsr     %C0\n"
+        "ror     %B0\n"
+        "ror     %A0\n"
+        "ror     %D1\n"
+        "ror     %C1\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+template <> inline void rshift_carry_bit<2U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "lsr     %B0\n"
+        "ror     %A0\n"
+        "ror     %D1\n"
+        "ror     %C1\n"
+        "ror     %B1\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+template <> inline void rshift_carry_bit<3U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "lsr     %A0\n"
+        "ror     %D1\n"
+        "ror     %C1\n"
+        "ror     %B1\n"
+        "ror     %A1\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+// Shift left 1 bit, after moving k+1 bytes right. Byte 3-k of a is zero &
+// receives the bit.
+template <uint8_t k> 
+static inline void rshift_carry_unbit(uint32_t &a, uint32_t &carry);
+
+template <> inline void rshift_carry_unbit<0U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "lsl     %D1\n"
+        "rol     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        "rol     %D0\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+template <> inline void rshift_carry_unbit<1U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "lsl     %C1\n"
+        "rol     %D1\n"
+        "rol     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+template <> inline void rshift_carry_unbit<2U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "lsl     %B1\n"
+        "rol     %C1\n"
+        "rol     %D1\n"
+        "rol     %A0\n"
+        "rol     %B0\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+template <> inline void rshift_carry_unbit<3U>(uint32_t &a, uint32_t &carry) {
+    asm(
+        "lsl     %A1\n"
+        "rol     %B1\n"
+        "rol     %C1\n"
+        "rol     %D1\n"
+        "rol     %A0\n"
+        : "+r" (a), "+r" (carry)
+        : 
+        : 
+    );
+}
+
+// Shift right by k bytes and r (0-7) bits.
+template <uint8_t k, uint8_t r, bool overshoot = (r>4U)> 
+struct rshift_carry_t {
+    static inline void shift(uint32_t &a, uint32_t &carry) {
+        rshift_carry_bytes<k>(a, carry);
+        carry_steps_t<&rshift_carry_bit<k>, r>::apply(a, carry);
+    }
+};
+template <uint8_t k, uint8_t r> 
+struct rshift_carry_t<k, r, true> {
+    static inline void shift(uint32_t &a, uint32_t &carry) {
+        rshift_carry_bytes<k+1U>(a, carry);
+        carry_steps_t<&rshift_carry_unbit<k>, 8U-r>::apply(a, carry);
+    }
+};
+
+#endif
+
+}
+/// @endcond
+
+/// @{
+/// @brief Left shift that also returns the bits shifted out: a 64-bit (carry:a)<<b of a
+/// 32-bit limb, in one pass.
+///
+/// E.g. chaining limbs, least significant first: `limbs[i] = lshift_carry<b>(limbs[i], out) | in;`
+/// @tparam b Number of bits to shift, 1 to 31
+/// @param a value to shift
+/// @param carry Set to the b bits shifted out, in the low bits: a>>(32-b)
+/// @return a<<b
+template <uint8_t b> 
+static inline uint32_t lshift_carry(uint32_t a, uint32_t &carry) {
+    static_assert(b>0U && b<32U, "Carry shifts are 1 to 31 bits");
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    carry = 0U;
+    afs_detail::lshift_carry_t<b/8U, b%8U>::shift(a, carry);
+    return a;
+#else
+    carry = a >> (32U-b);
+    return a << b;
+#endif
+}
+
+/// @brief Right shift that also returns the bits shifted out: a 64-bit (a:carry)>>b of a
+/// 32-bit limb, in one pass.
+/// @tparam b Number of bits to shift, 1 to 31
+/// @param a value to shift
+/// @param carry Set to the b bits shifted out, in the high bits: a<<(32-b)
+/// @return a>>b
+template <uint8_t b> 
+static inline uint32_t rshift_carry(uint32_t a, uint32_t &carry) {
+    static_assert(b>0U && b<32U, "Carry shifts are 1 to 31 bits");
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    carry = 0U;
+    afs_detail::rshift_carry_t<b/8U, b%8U>::shift(a, carry);
+    return a;
+#else
+    carry = a << (32U-b);
+    return a >> b;
+#endif
+}
+/// @}
+
+/// @{
+/// @brief Shift a multi-precision value, stored as an array of limbs with the least
+/// significant first. Each limb is shifted once, using lshift_carry/rshift_carry.
+/// @tparam b Number of bits to shift, 1 to 31
+/// @param limbs The value to shift, in place
+/// @param count Number of limbs
+/// @return The bits shifted out of the value: in the low bits for a left shift,
+/// the high bits for a right shift.
+template <uint8_t b> 
+static inline uint32_t lshift_array(uint32_t *limbs, size_t count) {
+    uint32_t carryIn = 0U;
+    for (size_t index=0; index<count; ++index) {
+        uint32_t carryOut;
+        limbs[index] = lshift_carry<b>(limbs[index], carryOut) | carryIn;
+        carryIn = carryOut;
+    }
+    return carryIn;
+}
+
+template <uint8_t b> 
+static inline uint32_t rshift_array(uint32_t *limbs, size_t count) {
+    uint32_t carryIn = 0U;
+    while (count!=0U) {
+        --count;
+        uint32_t carryOut;
+        limbs[count] = rshift_carry<b>(limbs[count], carryOut) | carryIn;
+        carryIn = carryOut;
+    }
+    return carryIn;
+}
+/// @}
+
+/// @cond
+namespace afs_detail {
+
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+// Load sizeof(T) bytes from *p, starting at byte k. ldd addresses each byte by
+// offset, so the bytes that aren't needed are never loaded.
+template <typename T> 
+struct load_bytes_t;
+
+template <> 
+struct load_bytes_t<uint8_t> {
+    template <uint8_t k> 
+    static inline uint8_t load(const volatile uint32_t *p) {
+        uint8_t value;
+        asm(
+            "ldd     %0, %a1+%2\n"
+            : "=r" (value)
+            : "b" (p), "I" (k), "m" (*p)
+        );
+        return value;
+    }
+};
+
+template <> 
+struct load_bytes_t<uint16_t> {
+    template <uint8_t k> 
+    static inline uint16_t load(const volatile uint32_t *p) {
+        uint16_t value;
+        asm(
+            "ldd     %A0, %a1+%2\n"
+            "ldd     %B0, %a1+%3\n"
+            : "=&r" (value)
+            : "b" (p), "I" (k), "I" (k+1U), "m" (*p)
+        );
+        return value;
+    }
+};
+
+#if defined(__UINT24_MAX__)
+template <> 
+struct load_bytes_t<__uint24> {
+    template <uint8_t k> 
+    static inline __uint24 load(const volatile uint32_t *p) {
+        __uint24 value;
+        asm(
+            "ldd     %A0, %a1+%2\n"
+            "ldd     %B0, %a1+%3\n"
+            "ldd     %C0, %a1+%4\n"
+            : "=&r" (value)
+            : "b" (p), "I" (k), "I" (k+1U), "I" (k+2U), "m" (*p)
+        );
+        return value;
+    }
+};
+#endif
+
+// Shift a value in memory by k whole bytes and b%8 bits: only the 4-k bytes that
+// survive are loaded & shifted.
+template <uint8_t b, uint8_t k = b/8U> 
+struct memory_shift_t {
+    typedef typename uint_bytes_t<(uint8_t)(4U-k)>::type span_t;
+
+    static inline uint32_t rshift(const volatile uint32_t *p) {
+        return (uint32_t)field_shift_t<b%8U>::right(load_bytes_t<span_t>::template load<k>(p));
+    }
+    static inline uint32_t lshift(const volatile uint32_t *p) {
+        return (uint32_t)field_shift_t<b%8U>::left(load_bytes_t<span_t>::template load<0U>(p)) << (k*8U);
+    }
+};
+
+// Every byte survives
+template <uint8_t b> 
+struct memory_shift_t<b, 0U> {
+    static inline uint32_t rshift(const volatile uint32_t *p) { return ::rshift<b>((uint32_t)*p); }
+    static inline uint32_t lshift(const volatile uint32_t *p) { return ::lshift<b>((uint32_t)*p); }
+};
+#endif
+
+}
+/// @endcond
+
+/// @{
+/// @brief Shift a uint32_t in memory, only loading the bytes that survive the shift.
+///
+/// E.g. `rshift<20U>(&ticks)` loads the top 2 bytes of ticks & shifts them 4 bits,
+/// instead of loading all 4 bytes & then moving them. Useful for struct members
+/// & volatile variables shared with an ISR. As for any 32-bit access, the load 
+/// isn't atomic.
+/// @tparam b Number of bits to shift, 1 to 31
+/// @param p value to shift
+/// @return *p>>b or *p<<b
+template <uint8_t b> 
+static inline uint32_t rshift(const volatile uint32_t *p) {
+    static_assert(b>0U && b<32U, "Shift must be 1 to 31 bits");
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return afs_detail::memory_shift_t<b>::rshift(p);
+#else
+    return *p >> b;
+#endif
+}
+
+template <uint8_t b> 
+static inline uint32_t lshift(const volatile uint32_t *p) {
+    static_assert(b>0U && b<32U, "Shift must be 1 to 31 bits");
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return afs_detail::memory_shift_t<b>::lshift(p);
+#else
+    return *p << b;
+#endif
+}
+/// @}
+
+/// @{
+/// @brief Shift a uint32_t shared with an ISR in place, with interrupts disabled for as short a time as possible.
+///
+/// E.g. `acc >>= 4` inside an `ATOMIC_BLOCK` -> `atomic_rshift_assign<4U>(acc)`.
+/// Only the load, the optimized shift & the store happen with interrupts disabled:
+/// the load skips any bytes that are shifted out (see `rshift<b>(const volatile uint32_t*)`).
+/// The interrupt flag is restored afterwards, so this is safe to call from an ISR.
+///
+/// @note Only atomic on AVR: elsewhere this is a plain shift.
+/// @tparam b Number of bits to shift, 1 to 31
+/// @param a value to shift
+/// @return The new value of a
+template <uint8_t b> 
+static inline uint32_t atomic_rshift_assign(volatile uint32_t &a) {
+#if defined(__AVR__)
+    uint8_t sreg = SREG;
+    cli();
+    uint32_t result = rshift<b>(&a);
+    a = result;
+    SREG = sreg;
+    return result;
+#else
+    return a = rshift<b>(&a);
+#endif
+}
+
+template <uint8_t b> 
+static inline uint32_t atomic_lshift_assign(volatile uint32_t &a) {
+#if defined(__AVR__)
+    uint8_t sreg = SREG;
+    cli();
+    uint32_t result = lshift<b>(&a);
+    a = result;
+    SREG = sreg;
+    return result;
+#else
+    return a = lshift<b>(&a);
+#endif
+}
+/// @}
+
+/// @cond
+namespace afs_detail {
+
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+// Leading zeros of a non-zero byte: a nibble step, then 2 & 1 bit steps
+static inline uint8_t clz8(uint8_t a) {
+    uint8_t count = 0U;
+    if (a<0x10U) { count = 4U; a = (uint8_t)(a << 4U); }
+    if (a<0x40U) { count = (uint8_t)(count+2U); a = (uint8_t)(a << 2U); }
+    if (a<0x80U) { count = (uint8_t)(count+1U); }
+    return count;
+}
+
+// Trailing zeros of a non-zero byte
+static inline uint8_t ctz8(uint8_t a) {
+    uint8_t count = 0U;
+    if ((a & 0x0FU)==0U) { count = 4U; a = (uint8_t)(a >> 4U); }
+    if ((a & 0x03U)==0U) { count = (uint8_t)(count+2U); a = (uint8_t)(a >> 2U); }
+    if ((a & 0x01U)==0U) { count = (uint8_t)(count+1U); }
+    return count;
+}
+#endif
+
+// Bits in an unsigned long above the low 32
+static constexpr uint8_t ulong_excess_bits = (uint8_t)((sizeof(unsigned long)-sizeof(uint32_t))*8U);
+
+}
+/// @endcond
+
+/// @{
+/// @brief Count leading (clz32) or trailing (ctz32) zero bits of a uint32_t.
+///
+/// A replacement for `__builtin_clzl`/`__builtin_ctzl`, which avr-gcc implements with a
+/// bit by bit loop. Whole zero bytes are skipped first (they are just registers to test),
+/// then the last byte is finished with a nibble & two bit steps.
+/// Unlike the builtins, a is allowed to be zero.
+/// @param a value to count
+/// @return Number of zero bits: 32 if a is 0
+static inline uint8_t clz32(uint32_t a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    uint8_t top = extract<24U, 8U>(a);
+    uint8_t count = 0U;
+    if (top==0U) {
+        top = extract<16U, 8U>(a);
+        count = 8U;
+        if (top==0U) {
+            top = extract<8U, 8U>(a);
+            count = 16U;
+            if (top==0U) {
+                top = (uint8_t)a;
+                count = 24U;
+                if (top==0U) {
+                    return 32U;
+                }
+            }
+        }
+    }
+    return (uint8_t)(count + afs_detail::clz8(top));
+#else
+    return a==0U ? (uint8_t)32U : (uint8_t)(__builtin_clzl(a) - afs_detail::ulong_excess_bits);
+#endif
+}
+
+static inline uint8_t ctz32(uint32_t a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    uint8_t bottom = (uint8_t)a;
+    uint8_t count = 0U;
+    if (bottom==0U) {
+        bottom = extract<8U, 8U>(a);
+        count = 8U;
+        if (bottom==0U) {
+            bottom = extract<16U, 8U>(a);
+            count = 16U;
+            if (bottom==0U) {
+                bottom = extract<24U, 8U>(a);
+                count = 24U;
+                if (bottom==0U) {
+                    return 32U;
+                }
+            }
+        }
+    }
+    return (uint8_t)(count + afs_detail::ctz8(bottom));
+#else
+    return a==0U ? (uint8_t)32U : (uint8_t)__builtin_ctzl(a);
+#endif
+}
+/// @}
+
+/// @brief A uint32_t shifted left until its top bit is set: see normalize()
+struct normalized_t {
+    /// @brief The left justified value
+    uint32_t value;
+    /// @brief Number of places the value was shifted left: 32 if it is 0
+    uint8_t exponent;
+};
+
+/// @brief Left justify a uint32_t: a << clz32(a), plus clz32(a).
+///
+/// E.g. for adaptive gains & log scaled table lookups. The shift is done as the
+/// leading zeros are found: whole bytes are moved (no shifting), then at most
+/// one 4, one 2 & one 1 bit shift. That replaces `__builtin_clzl` plus a runtime shift.
+/// @param a value to normalize
+/// @return The left justified value & the shift distance. {0, 32} if a is 0
+static inline normalized_t normalize(uint32_t a) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    if (a==0U) {
+        return normalized_t{ 0U, 32U };
+    }
+    uint8_t exponent = 0U;
+    while (extract<24U, 8U>(a)==0U) {
+        a = lshift<8U>(a);
+        exponent = (uint8_t)(exponent+8U);
+    }
+    if (extract<28U, 4U>(a)==0U) {
+        a = lshift<4U>(a);
+        exponent = (uint8_t)(exponent+4U);
+    }
+    if (extract<30U, 2U>(a)==0U) {
+        a = lshift<2U>(a);
+        exponent = (uint8_t)(exponent+2U);
+    }
+    if (extract<31U, 1U>(a)==0U) {
+        a = lshift<1U>(a);
+        exponent = (uint8_t)(exponent+1U);
+    }
+    return normalized_t{ a, exponent };
+#else
+    return a==0U ? normalized_t{ 0U, 32U } : normalized_t{ a << clz32(a), clz32(a) };
+#endif
+}
+
+/// @cond
+namespace afs_detail {
+
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+// Load a uint32_t & advance the pointer: post-increment addressing, so no
+// pointer arithmetic is needed between elements.
+static inline uint32_t load_inc(const uint32_t *&p) {
+    uint32_t value;
+    asm volatile(
+        "ld      %A0, %a1+\n"
+        "ld      %B0, %a1+\n"
+        "ld      %C0, %a1+\n"
+        "ld      %D0, %a1+\n"
+        : "=r" (value), "+e" (p)
+        : 
+        : "memory"
+    );
+    return value;
+}
+
+// Store a uint32_t & advance the pointer.
+static inline void store_inc(uint32_t *&p, uint32_t value) {
+    asm volatile(
+        "st      %a0+, %A1\n"
+        "st      %a0+, %B1\n"
+        "st      %a0+, %C1\n"
+        "st      %a0+, %D1\n"
+        : "+e" (p)
+        : "r" (value)
+        : "memory"
+    );
+}
+
+// Shift one element in place. Reading & writing through separate pointers
+// means both can post-increment.
+template <uint32_t (*pShift)(uint32_t)> 
+static inline void shift_step(const uint32_t *&pRead, uint32_t *&pWrite) {
+    store_inc(pWrite, pShift(load_inc(pRead)));
+}
+
+// Apply a shift to n elements in place, 4 per loop iteration: the loop
+// control is only paid once per 4 elements.
+template <uint32_t (*pShift)(uint32_t)> 
+static inline void shift_n(uint32_t *buf, size_t n) {
+    const uint32_t *pRead = buf;
+    for (size_t blocks = n/4U; blocks!=0U; --blocks) {
+        shift_step<pShift>(pRead, buf);
+        shift_step<pShift>(pRead, buf);
+        shift_step<pShift>(pRead, buf);
+        shift_step<pShift>(pRead, buf);
+    }
+    // The remaining 0-3 elements
+    if ((n & 2U)!=0U) {
+        shift_step<pShift>(pRead, buf);
+        shift_step<pShift>(pRead, buf);
+    }
+    if ((n & 1U)!=0U) {
+        shift_step<pShift>(pRead, buf);
+    }
+}
+#endif
+
+}
+/// @endcond
+
+/// @{
+/// @brief Shift every element of a buffer in place: buf[i] >>= b or buf[i] <<= b.
+///
+/// The elements are streamed through with post-increment loads & stores, so
+/// there is no per element address calculation, and the loop is unrolled 4 times
+/// to spread the loop control over 4 elements. Each distance inlines 7 copies of
+/// the shift.
+/// @tparam b Number of bits to shift, 1 to 31
+/// @param buf Elements to shift
+/// @param n Number of elements
+template <uint8_t b> 
+static inline void rshift_n(uint32_t *buf, size_t n) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    afs_detail::shift_n<&afs_detail::apply_shift<b, uint32_t, afs_detail::rshift<b>>>(buf, n);
+#else
+    for (; n!=0U; --n, ++buf) {
+        *buf >>= b;
+    }
+#endif
+}
+
+template <uint8_t b> 
+static inline void lshift_n(uint32_t *buf, size_t n) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    afs_detail::shift_n<&afs_detail::apply_shift<b, uint32_t, afs_detail::lshift<b>>>(buf, n);
+#else
+    for (; n!=0U; --n, ++buf) {
+        *buf <<= b;
+    }
+#endif
+}
+/// @}
+
+/// @cond
+namespace afs_detail {
+
+#if defined(AFS_USE_OPTIMIZED_SHIFTS) && defined(__AVR_HAVE_MUL__)
+// 16x16=>32 bit multiply using the hardware multiplier. GCC either calls
+// __umulhisi3 or, if it can't see the operands are 16-bit, __mulsi3.
+static inline uint32_t mul16x16(uint16_t a, uint16_t b) {
+    uint32_t product;
+    uint8_t zero;
+    asm(
+        "clr     %1\n"
+        "mul     %A2, %A3\n"
+        "movw    %A0, __tmp_reg__\n"
+        "mul     %B2, %B3\n"
+        "movw    %C0, __tmp_reg__\n"
+        "mul     %B2, %A3\n"
+        "add     %B0, __tmp_reg__\n"
+        "adc     %C0, __zero_reg__\n"
+        "adc     %D0, %1\n"
+        "mul     %A2, %B3\n"
+        "add     %B0, __tmp_reg__\n"
+        "adc     %C0, __zero_reg__\n"
+        "adc     %D0, %1\n"
+        "clr     __zero_reg__\n"
+        : "=&r" (product), "=&r" (zero)
+        : "r" (a), "r" (b)
+    );
+
+    return product;
+}
+#else
+static inline uint32_t mul16x16(uint16_t a, uint16_t b) {
+    return (uint32_t)a * b;
+}
+#endif
+
+// (a*b)>>shift for a uint32_t a, from two 16x16 multiplies: lo=a[0:15]*b and
+// hi=a[16:31]*b. So a*b = (hi<<16) + lo.
+template <uint8_t shift, bool gte16 = (shift>=16U)> 
+struct mul32x16_shr_t {
+    // The bits of lo that survive fit alongside hi.
+    static inline uint32_t mul_shr(uint32_t a, uint16_t b) {
+        return ::rshift<shift-16U, uint32_t>(mul16x16((uint16_t)(a >> 16U), b) 
+                                         + (uint16_t)(mul16x16((uint16_t)a, b) >> 16U));
+    }
+};
+
+template <uint8_t shift> 
+struct mul32x16_shr_t<shift, false> {
+    // Exact, since the low shift bits of hi<<16 are zero.
+    static inline uint32_t mul_shr(uint32_t a, uint16_t b) {
+        return ::lshift<16U-shift>(mul16x16((uint16_t)(a >> 16U), b)) 
+             + ::rshift<shift, uint32_t>(mul16x16((uint16_t)a, b));
+    }
+};
+
+}
+/// @endcond
+
+/// @{
+/// @brief Fused multiply & right shift, for fixed point maths: (a*b)>>shift.
+///
+/// The multiply uses the hardware multiplier (if any) & only the product bytes
+/// that survive the shift are shifted. On cores with a hardware multiplier, this
+/// is faster than the C expression (multiply, then shift): see test_mul_shr_perf.
+/// @tparam shift Number of bits to shift the product: 0-31 for uint16_t a, 0-47 for uint32_t a
+/// @param a value to multiply
+/// @param b value to multiply
+/// @return (a*b)>>shift, calculated without overflow
+template <uint8_t shift> 
+static inline constexpr uint32_t mul_shr(uint16_t a, uint16_t b) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) && __builtin_constant_p(b) 
+        ? ((uint32_t)a * b) >> shift 
+        : rshift<shift, uint32_t>(afs_detail::mul16x16(a, b));
+#else
+    return ((uint32_t)a * b) >> shift;
+#endif
+}
+
+template <uint8_t shift> 
+static inline constexpr uint32_t mul_shr(uint32_t a, uint16_t b) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return __builtin_constant_p(a) && __builtin_constant_p(b) 
+        ? (uint32_t)(((uint64_t)a * b) >> shift) 
+        : afs_detail::mul32x16_shr_t<shift>::mul_shr(a, b);
+#else
+    return (uint32_t)(((uint64_t)a * b) >> shift);
+#endif
+}
+/// @}
+
+/// @cond
+// Fixed point storage & rescaling.
+namespace afs_detail {
+
+template <bool isSigned, bool is32> 
+struct fixed_types_t;
+template <> 
+struct fixed_types_t<false, false> { typedef uint16_t raw_t; typedef uint32_t wide_t; };
+template <> 
+struct fixed_types_t<false, true> { typedef uint32_t raw_t; typedef uint64_t wide_t; };
+template <> 
+struct fixed_types_t<true, false> { typedef int16_t raw_t; typedef int32_t wide_t; };
+template <> 
+struct fixed_types_t<true, true> { typedef int32_t raw_t; typedef int64_t wide_t; };
+
+// The wider of two types
+template <typename T1, typename T2, bool firstIsWider = (sizeof(T1)>sizeof(T2))> 
+struct wider_t { typedef T1 type; };
+template <typename T1, typename T2> 
+struct wider_t<T1, T2, false> { typedef T2 type; };
+
+// Change the number of fraction bits, from fromBits to toBits
+template <uint8_t fromBits, uint8_t toBits, bool isLeft = (toBits>fromBits)> 
+struct rescale_t {
+    template <typename T>
+    static constexpr T apply(T a) { return field_shift_t<(uint8_t)(toBits-fromBits)>::left(a); }
+};
+template <uint8_t fromBits, uint8_t toBits> 
+struct rescale_t<fromBits, toBits, false> {
+    template <typename T>
+    static constexpr T apply(T a) { return field_shift_t<(uint8_t)(fromBits-toBits)>::right(a); }
+};
+
+// (a*b)>>F, truncated to the storage type
+template <uint8_t F, bool gte16 = (F>16U)> 
+struct fixed_mul_t {
+    static constexpr uint16_t mul(uint16_t a, uint16_t b) { return (uint16_t)::mul_shr<F>(a, b); }
+    // a*b == a*b_lo + ((a*b_hi)<<16): no 64-bit multiply needed
+    static constexpr uint32_t mul(uint32_t a, uint32_t b) { 
+        return ::mul_shr<F>(a, (uint16_t)b) 
+             + field_shift_t<(uint8_t)(16U-F)>::left(::mul_shr<0U>(a, ::rshift<16U, uint16_t>(b))); 
+    }
+    static constexpr int16_t mul(int16_t a, int16_t b) { return (int16_t)field_shift_t<F>::right((int32_t)a * b); }
+    static constexpr int32_t mul(int32_t a, int32_t b) { return (int32_t)field_shift_t<F>::right((int64_t)a * b); }
+};
+template <uint8_t F> 
+struct fixed_mul_t<F, true> {
+    static constexpr uint32_t mul(uint32_t a, uint32_t b) { return (uint32_t)::rshift<F>((uint64_t)a * b); }
+    static constexpr int32_t mul(int32_t a, int32_t b) { return (int32_t)::rshift<F>((int64_t)a * b); }
+};
+
+// (a<<F)/b, truncated to the storage type
+template <uint8_t F> 
+struct fixed_div_t {
+    static constexpr uint16_t div(uint16_t a, uint16_t b) { return (uint16_t)(field_shift_t<F>::left((uint32_t)a) / b); }
+    static constexpr uint32_t div(uint32_t a, uint32_t b) { return (uint32_t)(field_shift_t<F>::left((uint64_t)a) / b); }
+    static constexpr int16_t div(int16_t a, int16_t b) { return (int16_t)(field_shift_t<F>::left((int32_t)a) / b); }
+    static constexpr int32_t div(int32_t a, int32_t b) { return (int32_t)(field_shift_t<F>::left((int64_t)a) / b); }
+};
+
+}
+/// @endcond
+
+/// @brief Q format fixed point number: I integer bits & F fraction bits.
+///
+/// Conversions, multiplies, divides & format changes all use the optimized shifts,
+/// so there is no shift to hand convert at each call site. E.g.
+/// @code
+///      ufixed<16, 16> gain = ufixed<16, 16>::from_float(1.5F);
+///      uint32_t scaled = (ufixed<16, 16>::from_int(adc) * gain).to_int();
+/// @endcode
+///
+/// Values are stored in 16 bits if I+F<=16, otherwise 32 bits. Multiplies & 
+/// divides truncate (towards -infinity for a multiply, towards 0 for a divide)
+/// & overflow wraps, as it would for the equivalent integer expression.
+///
+/// @tparam I Number of integer bits. For a signed value, this includes the sign bit.
+/// @tparam F Number of fraction bits
+/// @tparam isSigned true for a two's complement value
+template <uint8_t I, uint8_t F, bool isSigned> 
+class fixed_point_t {
+    static_assert(I+F>0U && I+F<=32U, "Fixed point values must be 1-32 bits");
+
+    typedef afs_detail::fixed_types_t<isSigned, (I+F>16U)> types_t;
+
+public:
+    /// @brief The storage type: the raw value is the number * 2^F
+    typedef typename types_t::raw_t raw_t;
+
+    /// @brief Zero
+    constexpr fixed_point_t() : _raw(0) {}
+
+    /// @brief Convert from another format. Excess fraction bits are truncated & 
+    /// excess integer bits are lost.
+    template <uint8_t I2, uint8_t F2> 
+    constexpr explicit fixed_point_t(const fixed_point_t<I2, F2, isSigned> &other) 
+        : _raw((raw_t)afs_detail::rescale_t<F2, F>::apply(
+            (typename afs_detail::wider_t<raw_t, typename fixed_point_t<I2, F2, isSigned>::raw_t>::type)other.raw())) {}
+
+    /// @brief Construct from the raw value: the number * 2^F
+    static constexpr fixed_point_t from_raw(raw_t raw) { return fixed_point_t(raw, raw_tag_t()); }
+    /// @brief Construct from an integer: value<<F
+    static constexpr fixed_point_t from_int(raw_t value) { return from_raw(afs_detail::field_shift_t<F>::left(value)); }
+    /// @brief Construct from a float, truncating any bits beyond F
+    static constexpr fixed_point_t from_float(float value) { return from_raw((raw_t)(value * scale())); }
+
+    /// @brief The raw value: the number * 2^F
+    constexpr raw_t raw() const { return _raw; }
+    /// @brief The integer part: raw()>>F, so negative values round towards -infinity.
+    constexpr raw_t to_int() const { return afs_detail::field_shift_t<F>::right(_raw); }
+    /// @brief Convert to a float
+    constexpr float to_float() const { return (float)_raw / scale(); }
+
+    constexpr fixed_point_t operator+(const fixed_point_t &rhs) const { return from_raw((raw_t)(_raw + rhs._raw)); }
+    constexpr fixed_point_t operator-(const fixed_point_t &rhs) const { return from_raw((raw_t)(_raw - rhs._raw)); }
+    constexpr fixed_point_t operator-() const { return from_raw((raw_t)-_raw); }
+    constexpr fixed_point_t operator*(const fixed_point_t &rhs) const { return from_raw(afs_detail::fixed_mul_t<F>::mul(_raw, rhs._raw)); }
+    constexpr fixed_point_t operator/(const fixed_point_t &rhs) const { return from_raw(afs_detail::fixed_div_t<F>::div(_raw, rhs._raw)); }
+
+    fixed_point_t& operator+=(const fixed_point_t &rhs) { return *this = *this + rhs; }
+    fixed_point_t& operator-=(const fixed_point_t &rhs) { return *this = *this - rhs; }
+    fixed_point_t& operator*=(const fixed_point_t &rhs) { return *this = *this * rhs; }
+    fixed_point_t& operator/=(const fixed_point_t &rhs) { return *this = *this / rhs; }
+
+    constexpr bool operator==(const fixed_point_t &rhs) const { return _raw==rhs._raw; }
+    constexpr bool operator!=(const fixed_point_t &rhs) const { return _raw!=rhs._raw; }
+    constexpr bool operator<(const fixed_point_t &rhs) const { return _raw<rhs._raw; }
+    constexpr bool operator<=(const fixed_point_t &rhs) const { return _raw<=rhs._raw; }
+    constexpr bool operator>(const fixed_point_t &rhs) const { return _raw>rhs._raw; }
+    constexpr bool operator>=(const fixed_point_t &rhs) const { return _raw>=rhs._raw; }
+
+private:
+    struct raw_tag_t {};
+    constexpr fixed_point_t(raw_t raw, raw_tag_t) : _raw(raw) {}
+
+    static constexpr float scale() { return (float)(UINT64_C(1) << F); }
+
+    raw_t _raw;
+};
+
+/// @brief Unsigned fixed point number: see fixed_point_t
+template <uint8_t I, uint8_t F> 
+using ufixed = fixed_point_t<I, F, false>;
+
+/// @brief Signed fixed point number: see fixed_point_t. I includes the sign bit.
+template <uint8_t I, uint8_t F> 
+using sfixed = fixed_point_t<I, F, true>;
+
+#if defined(AFS_RUNTIME_API)
+
+#if defined(AFS_USE_OPTIMIZED_SHIFTS) 
+
+/// @cond
+// The three runtime shift implementations. See rshift(uint32_t, uint8_t) for
+// how one is selected.
+namespace afs_detail {
+
+// Dispatch to the constant distance shifts. Fast on average, but the cost
+// varies with the distance and distances over 15 recurse.
+static inline uint32_t rshift_switch(uint32_t a, uint8_t b)
+{
+    switch (b)
+    {
+        case 0: return a;
+        case 1: return rshift<1U>(a);
+        case 2: return rshift<2U>(a);
+        case 3: return rshift<3U>(a);
+        case 4: return rshift<4U>(a);
+        case 5: return rshift<5U>(a);
+        case 6: return rshift<6U>(a);
+        case 7: return rshift<7U>(a);
+        case 8: return rshift<8U>(a);
+        case 9: return rshift<9U>(a);
+        case 10: return rshift<10U>(a);
+        case 11: return rshift<11U>(a);
+        case 12: return rshift<12U>(a);
+        case 13: return rshift<13U>(a);
+        case 14: return rshift<14U>(a);
+        case 15: return rshift<15U>(a);
+        //  Note recursion here.
+        default: return rshift_switch(rshift<16>(a), (uint8_t)(b-UINT8_C(16)));
+    }
+}
+
+static inline uint32_t lshift_switch(uint32_t a, uint8_t b)
+{
+    switch (b)
+    {
+        case 0: return a;
+        case 1: return lshift<1U>(a);
+        case 2: return lshift<2U>(a);
+        case 3: return lshift<3U>(a);
+        case 4: return lshift<4U>(a);
+        case 5: return lshift<5U>(a);
+        case 6: return lshift<6U>(a);
+        case 7: return lshift<7U>(a);
+        case 8: return lshift<8U>(a);
+        case 9: return lshift<9U>(a);
+        case 10: return lshift<10U>(a);
+        case 11: return lshift<11U>(a);
+        case 12: return lshift<12U>(a);
+        case 13: return lshift<13U>(a);
+        case 14: return lshift<14U>(a);
+        case 15: return lshift<15U>(a);
+        //  Note recursion here.
+        default: return lshift_switch(lshift<16>(a), (uint8_t)(b-UINT8_C(16)));
+    }
+}
+
+// Constant time: the distance is applied as 1, 2 & 4 bit steps followed by
+// 1 & 2 byte moves. Each step is a run of single word instructions guarded by
+// sbrc, which costs 2 cycles whether the instruction is skipped or not. So
+// every distance takes 59 cycles.
+static inline uint32_t rshift_sbrc(uint32_t a, uint8_t b)
+{
+    uint8_t mask;
+    asm(
+        // 1 bit
+        "sbrc    %3, 0\n"
+        "lsr     %D0\n"
+        "sbrc    %3, 0\n"
+        "ror     %C0\n"
+        "sbrc    %3, 0\n"
+        "ror     %B0\n"
+        "sbrc    %3, 0\n"
+        "ror     %A0\n"
+        // 2 bits
+        "sbrc    %3, 1\n"
+        "lsr     %D0\n"
+        "sbrc    %3, 1\n"
+        "ror     %C0\n"
+        "sbrc    %3, 1\n"
+        "ror     %B0\n"
+        "sbrc    %3, 1\n"
+        "ror     %A0\n"
+        "sbrc    %3, 1\n"
+        "lsr     %D0\n"
+        "sbrc    %3, 1\n"
+        "ror     %C0\n"
+        "sbrc    %3, 1\n"
+        "ror     %B0\n"
+        "sbrc    %3, 1\n"
+        "ror     %A0\n"
+        // 4 bits. With bit 2 clear the mask is 0xff, the swaps are
+        // skipped and each eor pair cancels out.
+        "ldi     %1, 0xff\n"
+        "sbrc    %3, 2\n"
+        "ldi     %1, 0x0f\n"
+        "sbrc    %3, 2\n"
+        "swap    %A0\n"
+        "and     %A0, %1\n"
+        "sbrc    %3, 2\n"
+        "swap    %B0\n"
+        "eor     %A0, %B0\n"
+        "and     %B0, %1\n"
+        "eor     %A0, %B0\n"
+        "sbrc    %3, 2\n"
+        "swap    %C0\n"
+        "eor     %B0, %C0\n"
+        "and     %C0, %1\n"
+        "eor     %B0, %C0\n"
+        "sbrc    %3, 2\n"
+        "swap    %D0\n"
+        "eor     %C0, %D0\n"
+        "and     %D0, %1\n"
+        "eor     %C0, %D0\n"
+        // 1 byte
+        "sbrc    %3, 3\n"
+        "mov     %A0, %B0\n"
+        "sbrc    %3, 3\n"
+        "mov     %B0, %C0\n"
+        "sbrc    %3, 3\n"
+        "mov     %C0, %D0\n"
+        "sbrc    %3, 3\n"
+        "mov     %D0, __zero_reg__\n"
+        // 2 bytes
+        "sbrc    %3, 4\n"
+        "movw    %A0, %C0\n"
+        "sbrc    %3, 4\n"
+        "mov     %C0, __zero_reg__\n"
+        "sbrc    %3, 4\n"
+        "mov     %D0, __zero_reg__\n"
+        : "=r" (a), "=&d" (mask)
+        : "0" (a), "r" (b)
+    );
+
+    return a;
+}
+
+static inline uint32_t lshift_sbrc(uint32_t a, uint8_t b)
+{
+    uint8_t mask;
+    asm(
+        // 1 bit
+        "sbrc    %3, 0\n"
+        "lsl     %A0\n"
+        "sbrc    %3, 0\n"
+        "rol     %B0\n"
+        "sbrc    %3, 0\n"
+        "rol     %C0\n"
+        "sbrc    %3, 0\n"
+        "rol     %D0\n"
+        // 2 bits
+        "sbrc    %3, 1\n"
+        "lsl     %A0\n"
+        "sbrc    %3, 1\n"
+        "rol     %B0\n"
+        "sbrc    %3, 1\n"
+        "rol     %C0\n"
+        "sbrc    %3, 1\n"
+        "rol     %D0\n"
+        "sbrc    %3, 1\n"
+        "lsl     %A0\n"
+        "sbrc    %3, 1\n"
+        "rol     %B0\n"
+        "sbrc    %3, 1\n"
+        "rol     %C0\n"
+        "sbrc    %3, 1\n"
+        "rol     %D0\n"
+        // 4 bits. With bit 2 clear the mask is 0xff, the swaps are
+        // skipped and each eor pair cancels out.
+        "ldi     %1, 0xff\n"
+        "sbrc    %3, 2\n"
+        "ldi     %1, 0xf0\n"
+        "sbrc    %3, 2\n"
+        "swap    %D0\n"
+        "and     %D0, %1\n"
+        "sbrc    %3, 2\n"
+        "swap    %C0\n"
+        "eor     %D0, %C0\n"
+        "and     %C0, %1\n"
+        "eor     %D0, %C0\n"
+        "sbrc    %3, 2\n"
+        "swap    %B0\n"
+        "eor     %C0, %B0\n"
+        "and     %B0, %1\n"
+        "eor     %C0, %B0\n"
+        "sbrc    %3, 2\n"
+        "swap    %A0\n"
+        "eor     %B0, %A0\n"
+        "and     %A0, %1\n"
+        "eor     %B0, %A0\n"
+        // 1 byte
+        "sbrc    %3, 3\n"
+        "mov     %D0, %C0\n"
+        "sbrc    %3, 3\n"
+        "mov     %C0, %B0\n"
+        "sbrc    %3, 3\n"
+        "mov     %B0, %A0\n"
+        "sbrc    %3, 3\n"
+        "mov     %A0, __zero_reg__\n"
+        // 2 bytes
+        "sbrc    %3, 4\n"
+        "movw    %C0, %A0\n"
+        "sbrc    %3, 4\n"
+        "mov     %A0, __zero_reg__\n"
+        "sbrc    %3, 4\n"
+        "mov     %B0, __zero_reg__\n"
+        : "=r" (a), "=&d" (mask)
+        : "0" (a), "r" (b)
+    );
+
+    return a;
+}
+
+#if defined(__AVR_HAVE_MUL__)
+
+// Hardware multiplier: sbrc guarded byte moves as above, then each byte is
+// multiplied by a power of 2 and the product halves are merged with the
+// neighbouring bytes. Also constant time: 37 cycles for lshift, 44 for rshift.
+static inline uint32_t rshift_mul(uint32_t a, uint8_t b)
+{
+    uint8_t factor;
+    uint8_t spill;
+    asm(
+        // Bytes
+        "sbrc    %4, 3\n"
+        "mov     %A0, %B0\n"
+        "sbrc    %4, 3\n"
+        "mov     %B0, %C0\n"
+        "sbrc    %4, 3\n"
+        "mov     %C0, %D0\n"
+        "sbrc    %4, 3\n"
+        "mov     %D0, __zero_reg__\n"
+        "sbrc    %4, 4\n"
+        "movw    %A0, %C0\n"
+        "sbrc    %4, 4\n"
+        "mov     %C0, __zero_reg__\n"
+        "sbrc    %4, 4\n"
+        "mov     %D0, __zero_reg__\n"
+        // factor = 0x80>>(b & 7)
+        "ldi     %1, 0x80\n"
+        "sbrc    %4, 1\n"
+        "ldi     %1, 0x20\n"
+        "sbrc    %4, 0\n"
+        "lsr     %1\n"
+        "sbrc    %4, 2\n"
+        "swap    %1\n"
+        // Shift left 1 so that the factor fits in a byte when (b & 7)==0: the
+        // product is then a<<(8-(b & 7)) and we keep the top 4 bytes.
+        "lsl     %A0\n"
+        "rol     %B0\n"
+        "rol     %C0\n"
+        "rol     %D0\n"
+        "sbc     %2, %2\n"
+        "and     %2, %1\n"
+        // Bits
+        "mul     %A0, %1\n"
+        "mov     %A0, __zero_reg__\n"
+        "mul     %B0, %1\n"
+        "or      %A0, __tmp_reg__\n"
+        "mov     %B0, __zero_reg__\n"
+        "mul     %C0, %1\n"
+        "or      %B0, __tmp_reg__\n"
+        "mov     %C0, __zero_reg__\n"
+        "mul     %D0, %1\n"
+        "or      %C0, __tmp_reg__\n"
+        "mov     %D0, __zero_reg__\n"
+        "or      %D0, %2\n"
+        "clr     __zero_reg__\n"
+        : "=r" (a), "=&d" (factor), "=&r" (spill)
+        : "0" (a), "r" (b)
+    );
+
+    return a;
+}
+
+static inline uint32_t lshift_mul(uint32_t a, uint8_t b)
+{
+    uint8_t factor;
+    asm(
+        // Bytes
+        "sbrc    %3, 3\n"
+        "mov     %D0, %C0\n"
+        "sbrc    %3, 3\n"
+        "mov     %C0, %B0\n"
+        "sbrc    %3, 3\n"
+        "mov     %B0, %A0\n"
+        "sbrc    %3, 3\n"
+        "mov     %A0, __zero_reg__\n"
+        "sbrc    %3, 4\n"
+        "movw    %C0, %A0\n"
+        "sbrc    %3, 4\n"
+        "mov     %A0, __zero_reg__\n"
+        "sbrc    %3, 4\n"
+        "mov     %B0, __zero_reg__\n"
+        // factor = 1<<(b & 7)
+        "ldi     %1, 0x01\n"
+        "sbrc    %3, 1\n"
+        "ldi     %1, 0x04\n"
+        "sbrc    %3, 0\n"
+        "lsl     %1\n"
+        "sbrc    %3, 2\n"
+        "swap    %1\n"
+        // Bits
+        "mul     %D0, %1\n"
+        "mov     %D0, __tmp_reg__\n"
+        "mul     %C0, %1\n"
+        "mov     %C0, __tmp_reg__\n"
+        "or      %D0, __zero_reg__\n"
+        "mul     %B0, %1\n"
+        "mov     %B0, __tmp_reg__\n"
+        "or      %C0, __zero_reg__\n"
+        "mul     %A0, %1\n"
+        "mov     %A0, __tmp_reg__\n"
+        "or      %B0, __zero_reg__\n"
+        "clr     __zero_reg__\n"
+        : "=r" (a), "=&d" (factor)
+        : "0" (a), "r" (b)
+    );
+
+    return a;
+}
+
+#endif
+
+}
+/// @endcond
+
+/// @{
+/// @brief bitwise right/left shift by a distance only known at run time.
+///
+/// By default this dispatches to the constant distance shifts: fast on average,
+/// but the cost varies with the distance. Define either of these preprocessor
+/// flags for a branch free version with a fixed cost:
+/// * AFS_RUNTIME_CONSTANT_TIME: 59 cycles whatever the distance.
+/// * AFS_RUNTIME_MUL_SHIFT: uses the hardware multiplier, 37 cycles for lshift
+///   and 44 for rshift. Ignored on cores without MUL.
+///
+/// @param a value to shift
+/// @param b Number of bits to shift, 0 to 31
+/// @return a>>b or a<<b 
+static inline uint32_t rshift(uint32_t a, uint8_t b)
+{
+#if defined(AFS_RUNTIME_MUL_SHIFT) && defined(__AVR_HAVE_MUL__)
+    return afs_detail::rshift_mul(a, b);
+#elif defined(AFS_RUNTIME_CONSTANT_TIME)
+    return afs_detail::rshift_sbrc(a, b);
+#else
+    return afs_detail::rshift_switch(a, b);
+#endif
+}
+
+static inline uint32_t lshift(uint32_t a, uint8_t b)
+{
+#if defined(AFS_RUNTIME_MUL_SHIFT) && defined(__AVR_HAVE_MUL__)
+    return afs_detail::lshift_mul(a, b);
+#elif defined(AFS_RUNTIME_CONSTANT_TIME)
+    return afs_detail::lshift_sbrc(a, b);
+#else
+    return afs_detail::lshift_switch(a, b);
+#endif
+}
+/// @}
+
+#if defined(__UINT24_MAX__)
+
+/// @brief 24-bit bitwise right shift optimised for the specified shift distance
+/// @param a value to shift
+/// @param b Number of bits to shift, 0 to 23
+/// @return a>>b 
+static inline __uint24 rshift(__uint24 a, uint8_t b)
+{
+    switch (b)
+    {
+        case 0: return a;
+        case 1: return rshift<1U>(a);
+        case 2: return rshift<2U>(a);
+        case 3: return rshift<3U>(a);
+        case 4: return rshift<4U>(a);
+        case 5: return rshift<5U>(a);
+        case 6: return rshift<6U>(a);
+        case 7: return rshift<7U>(a);
+        case 8: return rshift<8U>(a);
+        case 9: return rshift<9U>(a);
+        case 10: return rshift<10U>(a);
+        case 11: return rshift<11U>(a);
+        case 12: return rshift<12U>(a);
+        case 13: return rshift<13U>(a);
+        case 14: return rshift<14U>(a);
+        case 15: return rshift<15U>(a);
+        // Only the high byte survives.
+        default: return (uint8_t)(a >> 16U) >> (uint8_t)(b-UINT8_C(16));
+    }
+}
+
+/// @brief 24-bit arithmetic (sign extending) right shift optimised for the specified shift distance
+/// @param a value to shift
+/// @param b Number of bits to shift, 0 to 23
+/// @return a>>b 
+static inline __int24 rshift(__int24 a, uint8_t b)
+{
+    switch (b)
+    {
+        case 0: return a;
+        case 1: return rshift<1U>(a);
+        case 2: return rshift<2U>(a);
+        case 3: return rshift<3U>(a);
+        case 4: return rshift<4U>(a);
+        case 5: return rshift<5U>(a);
+        case 6: return rshift<6U>(a);
+        case 7: return rshift<7U>(a);
+        case 8: return rshift<8U>(a);
+        case 9: return rshift<9U>(a);
+        case 10: return rshift<10U>(a);
+        case 11: return rshift<11U>(a);
+        case 12: return rshift<12U>(a);
+        case 13: return rshift<13U>(a);
+        case 14: return rshift<14U>(a);
+        case 15: return rshift<15U>(a);
+        // Only the high byte survives.
+        default: return (int8_t)(a >> 16U) >> (uint8_t)(b-UINT8_C(16));
+    }
+}
+
+/// @brief 24-bit bitwise left shift optimised for the specified shift distance
+/// @param a value to shift
+/// @param b Number of bits to shift, 0 to 23
+/// @return a<<b
+static inline __uint24 lshift(__uint24 a, uint8_t b)
+{
+    switch (b)
+    {
+        case 0: return a;
+        case 1: return lshift<1U>(a);
+        case 2: return lshift<2U>(a);
+        case 3: return lshift<3U>(a);
+        case 4: return lshift<4U>(a);
+        case 5: return lshift<5U>(a);
+        case 6: return lshift<6U>(a);
+        case 7: return lshift<7U>(a);
+        case 8: return lshift<8U>(a);
+        case 9: return lshift<9U>(a);
+        case 10: return lshift<10U>(a);
+        case 11: return lshift<11U>(a);
+        case 12: return lshift<12U>(a);
+        case 13: return lshift<13U>(a);
+        case 14: return lshift<14U>(a);
+        case 15: return lshift<15U>(a);
+        // Only the low byte survives.
+        default: return (__uint24)(uint8_t)((uint8_t)a << (uint8_t)(b-UINT8_C(16))) << 16U;
+    }
+}
+
+static inline __int24 lshift(__int24 a, uint8_t b) { return (__int24)lshift((__uint24)a, b); }
+
+#endif
+
+#else
+static inline uint32_t rshift(uint32_t a, uint8_t b) { return a >> b; }
+static inline uint32_t lshift(uint32_t a, uint8_t b) { return a << b; }
+#if defined(__UINT24_MAX__)
+static inline __uint24 rshift(__uint24 a, uint8_t b) { return a >> b; }
+static inline __int24 rshift(__int24 a, uint8_t b) { return a >> b; }
+static inline __uint24 lshift(__uint24 a, uint8_t b) { return a << b; }
+static inline __int24 lshift(__int24 a, uint8_t b) { return (__int24)((__uint24)a << b); }
+#endif
+#endif
+
+// These overloads are provided for completeness, but are not optimized.
+// They are primarily to support template code that needs to apply shift
+// to generic integral types
+static inline uint8_t rshift(uint8_t a, uint8_t b) {
+    return (uint8_t)(a>>b);
+}
+static inline uint16_t rshift(uint16_t a, uint8_t b) {
+    return (uint16_t)(a>>b);
+}
+static inline uint8_t lshift(uint8_t a, uint8_t b) {
+    return (uint8_t)(a<<b);
+}
+static inline uint16_t lshift(uint16_t a, uint8_t b) {
+    return (uint16_t)(a<<b);
+}
+
+#if defined(AFS_USE_OPTIMIZED_SHIFTS) 
+
+/// @cond
+namespace afs_detail {
+
+// As per rotl<b>: a whole byte rotation, then at most 4 single bit rotates.
+template <typename T>
+static inline T rotl_runtime(T a, uint8_t b)
+{
+    uint8_t bits = b & 7U;
+    if (bits>4U) {
+        // Rotate to the next whole byte, then back
+        b = (uint8_t)(b + 8U);
+    }
+    if ((b & 16U)!=0U) {
+        a = rotl_bytes<2U % sizeof(T)>(a);
+    }
+    if ((b & 8U)!=0U) {
+        a = rotl_bytes<1U>(a);
+    }
+    if (bits>4U) {
+        for (; bits<8U; ++bits) {
+            a = rotr_bit(a);
+        }
+    } else {
+        for (; bits>0U; --bits) {
+            a = rotl_bit(a);
+        }
+    }
+    return a;
+}
+
+}
+/// @endcond
+
+#endif
+
+/// @{
+/// @brief bitwise left/right rotate by a distance only known at run time.
+/// @param a value to rotate
+/// @param b Number of bits to rotate. Taken modulo the width of a.
+/// @return (a<<b) | (a>>(width-b)) or (a>>b) | (a<<(width-b))
+static inline uint32_t rotl(uint32_t a, uint8_t b) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return afs_detail::rotl_runtime(a, b);
+#else
+    return (a << (b & 31U)) | (a >> ((32U-b) & 31U));
+#endif
+}
+static inline uint32_t rotr(uint32_t a, uint8_t b) {
+    return rotl(a, (uint8_t)(32U-b));
+}
+static inline uint16_t rotl(uint16_t a, uint8_t b) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    return afs_detail::rotl_runtime(a, b);
+#else
+    return (uint16_t)((a << (b & 15U)) | (a >> ((16U-b) & 15U)));
+#endif
+}
+static inline uint16_t rotr(uint16_t a, uint8_t b) {
+    return rotl(a, (uint8_t)(16U-b));
+}
+/// @}
+
+#endif
+
+/// @cond
+namespace afs_detail {
+
+#if defined(AFS_HAS_TYPE_TRAITS)
+using std::integral_constant;
+#else
+// The same shape as std::integral_constant
+template <typename T, T v> 
+struct integral_constant {
+    static constexpr T value = v;
+    typedef T value_type;
+    constexpr operator value_type() const { return v; }
+};
+#endif
+
+// Shift by a distance only known at run time: the runtime API if available.
+static inline uint32_t runtime_lshift(uint32_t a, uint8_t b) {
+#if defined(AFS_RUNTIME_API)
+    return ::lshift(a, b);
+#else
+    return a << b;
+#endif
+}
+static inline int32_t runtime_lshift(int32_t a, uint8_t b) {
+    return (int32_t)runtime_lshift((uint32_t)a, b);
+}
+static inline uint32_t runtime_rshift(uint32_t a, uint8_t b) {
+#if defined(AFS_RUNTIME_API)
+    return ::rshift(a, b);
+#else
+    return a >> b;
+#endif
+}
+static inline int32_t runtime_rshift(int32_t a, uint8_t b) {
+    return a >> b;
+}
+
+}
+/// @endcond
+
+/// @brief A compile time shift distance, for use with fast_int_t. E.g. 
+/// @code
+///      fast_u32 toothDeltaV = ...;
+///      fast_u32 rpmDelta = toothDeltaV << shift_constant<10>();
+/// @endcode
+///
+/// The value being shifted must be a fast_int_t: for a plain uint32_t, the constant
+/// converts to an integer & the native operator is used, without a warning.
+///
+/// If the standard library is available, this is std::integral_constant & any
+/// std::integral_constant can be used as a distance.
+template <uint8_t b> 
+using shift_constant = afs_detail::integral_constant<uint8_t, b>;
+
+/// @brief Drop in replacement for a 32-bit integer, where << and >> use the optimized shifts.
+///
+/// Shifting by a shift_constant (or any std::integral_constant) uses lshift<b>/rshift<b>:
+/// there is no overhead compared to calling the templates directly. Shifting a
+/// fast_u32 by an integer uses the runtime API if AFS_RUNTIME_API is defined, otherwise
+/// the native operator. Shifting a fast_i32 by an integer always uses the native 
+/// operator: the runtime API has no signed shifts. E.g.
+/// @code
+///      fast_u32 toothDeltaV = ...;
+///      rpmDelta = (toothDeltaV << shift_constant<10>()) / (6 * toothDeltaT);
+/// @endcode
+///
+/// All other operations use the wrapped integer, which the type converts to implicitly.
+/// @tparam T uint32_t or int32_t
+template <typename T> 
+class fast_int_t {
+public:
+    /// @brief Zero
+    constexpr fast_int_t() : _value(0) {}
+    /// @brief Wrap an integer
+    constexpr fast_int_t(T value) : _value(value) {}
+    /// @brief The wrapped integer
+    constexpr operator T() const { return _value; }
+
+    /// @{
+    /// @brief Shift by a compile time distance. Distance 0 is allowed.
+    template <typename TDistance, TDistance b> 
+    constexpr fast_int_t operator<<(afs_detail::integral_constant<TDistance, b>) const { 
+        return afs_detail::field_shift_t<(uint8_t)b>::left(_value); 
+    }
+    template <typename TDistance, TDistance b> 
+    constexpr fast_int_t operator>>(afs_detail::integral_constant<TDistance, b>) const { 
+        return afs_detail::field_shift_t<(uint8_t)b>::right(_value); 
+    }
+    template <typename TDistance, TDistance b> 
+    fast_int_t& operator<<=(afs_detail::integral_constant<TDistance, b> distance) { return *this = *this << distance; }
+    template <typename TDistance, TDistance b> 
+    fast_int_t& operator>>=(afs_detail::integral_constant<TDistance, b> distance) { return *this = *this >> distance; }
+    /// @}
+
+    /// @{
+    /// @brief Shift by a distance only known at run time.
+    template <typename TDistance> 
+    fast_int_t operator<<(TDistance b) const { return afs_detail::runtime_lshift(_value, (uint8_t)b); }
+    template <typename TDistance> 
+    fast_int_t operator>>(TDistance b) const { return afs_detail::runtime_rshift(_value, (uint8_t)b); }
+    template <typename TDistance> 
+    fast_int_t& operator<<=(TDistance b) { return *this = *this << b; }
+    template <typename TDistance> 
+    fast_int_t& operator>>=(TDistance b) { return *this = *this >> b; }
+    /// @}
+
+    /// @{
+    /// @brief Compound assignment, as for the wrapped integer.
+    fast_int_t& operator+=(T rhs) { _value = (T)(_value + rhs); return *this; }
+    fast_int_t& operator-=(T rhs) { _value = (T)(_value - rhs); return *this; }
+    fast_int_t& operator*=(T rhs) { _value = (T)(_value * rhs); return *this; }
+    fast_int_t& operator/=(T rhs) { _value = (T)(_value / rhs); return *this; }
+    fast_int_t& operator%=(T rhs) { _value = (T)(_value % rhs); return *this; }
+    fast_int_t& operator&=(T rhs) { _value = (T)(_value & rhs); return *this; }
+    fast_int_t& operator|=(T rhs) { _value = (T)(_value | rhs); return *this; }
+    fast_int_t& operator^=(T rhs) { _value = (T)(_value ^ rhs); return *this; }
+    fast_int_t& operator++() { ++_value; return *this; }
+    fast_int_t& operator--() { --_value; return *this; }
+    fast_int_t operator++(int) { fast_int_t old = *this; ++_value; return old; }
+    fast_int_t operator--(int) { fast_int_t old = *this; --_value; return old; }
+    /// @}
+
+private:
+    T _value;
+};
+
+/// @brief Drop in replacement for uint32_t: see fast_int_t
+typedef fast_int_t<uint32_t> fast_u32;
+
+/// @brief Drop in replacement for int32_t: see fast_int_t
+typedef fast_int_t<int32_t> fast_i32;
+
 ///@}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+// Reads the flash word at a *word* address
+static inline uint16_t read_code_word(uint32_t wordAddress) {
+#if defined(RAMPZ)
+    return pgm_read_word_far(wordAddress*2U);
+#else
+    return pgm_read_word((uint16_t)(wordAddress*2U));
+#endif
+}
+
+// Size in bytes of a function with a single exit, found by decoding up to its ret.
+//
+// The only thing decoded is the length of each instruction, so the 2nd word of a 
+// 32-bit instruction (E.g. a call address) isn't mistaken for a ret.
+template <typename TFunction>
+static inline uint16_t function_size(TFunction pFunction) {
+    const uint16_t RET = 0x9508U;
+    const uint32_t start = (uint32_t)(uintptr_t)pFunction;
+    uint32_t address = start;
+    uint16_t opcode = read_code_word(address);
+    while (opcode!=RET) {
+        bool isCallOrJmp = (opcode & 0xFE0CU)==0x940CU;
+        bool isLdsOrSts = (opcode & 0xFC0FU)==0x9000U;
+        address += (isCallOrJmp || isLdsOrSts) ? 2U : 1U;
+        opcode = read_code_word(address);
+    }
+    return (uint16_t)((address + 1U - start)*2U);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+// Counts CPU cycles using the 16-bit Timer1 with no prescaler.
+//
+// Interrupts are disabled between start() & stop(), so nothing else is counted.
+// Measurements must be under 65536 cycles.
+class cycle_timer_t {
+private:
+    uint16_t start_count;
+    uint16_t end_count;
+    uint8_t sreg;
+
+    // Cycles counted by an empty start()/stop() pair
+    static uint16_t& overhead() {
+        static uint16_t cycles = 0;
+        return cycles;
+    }
+
+public:
+
+    // Take over Timer1: the Arduino core sets it up for PWM.
+    static void begin() {
+        TCCR1A = 0;
+        TCCR1B = _BV(CS10);
+        TCCR1C = 0;
+
+        cycle_timer_t timer;
+        timer.start();
+        timer.stop();
+        overhead() = (uint16_t)(timer.end_count - timer.start_count);
+    }
+
+    inline __attribute__((always_inline)) void start() {
+        sreg = SREG;
+        cli();
+        start_count = TCNT1;
+    }
+
+    inline __attribute__((always_inline)) void stop() {
+        end_count = TCNT1;
+        SREG = sreg;
+    }
+
+    uint16_t cycles() const {
+        return (uint16_t)(end_count - start_count - overhead());
+    }
+};
+
+// Pins a value to registers at this point. Use either side of the code being
+// timed, so that it can't be moved outside of start() & stop().
+template <typename T>
+static inline __attribute__((always_inline)) void cycle_barrier(T &value) {
+    asm volatile ("" : "+r" (value));
+}
@@ -1,15 +1,26 @@
 #include <Arduino.h>
 #include <unity.h>
 #include <avr/sleep.h>
+#include <util/atomic.h>
 #include "avr-fast-shift.h"
 #include "lambda_timer.hpp"
 #include "unity_print_timers.hpp"
+#include "cycle_timer.hpp"
+#include "code_size.hpp"
+
+// Constant values are shifted in C so the compiler can fold them. Pass test
+// values through here to make sure the optimized shift is tested instead.
+template <typename T>
+static T opaque(T value) {
+    volatile T copy = value;
+    return copy;
+}
 
 template <typename T, uint8_t b> 
 static void test_lshift(T shiftValue) {
     char szMsg[128];
     sprintf(szMsg, "Shift: %" PRIu8 ", Type Width: %" PRIu8 ", Value: %" PRIi32, b, (uint8_t)sizeof(shiftValue), (int32_t) shiftValue);
-    TEST_ASSERT_EQUAL_MESSAGE((T)(shiftValue << b), (lshift<b>(shiftValue)), szMsg);
+    TEST_ASSERT_EQUAL_MESSAGE((T)(shiftValue << b), (lshift<b>(opaque(shiftValue))), szMsg);
 }
 
 template <uint8_t shiftDistance, bool lt16, bool lt8>
@@ -20,6 +31,7 @@ struct test_lshift_t<shiftDistance, false, false>
 {    
     static void run(void) {
         test_lshift<uint32_t, shiftDistance>(UINT16_MAX * 31UL);
+        test_lshift<int32_t, shiftDistance>(INT32_C(-12345678));
     }
 };
 
@@ -29,6 +41,7 @@ struct test_lshift_t<shiftDistance, true, false>
     static void run(void) {
         test_lshift_t<shiftDistance, false, false>::run();
         test_lshift<uint16_t, shiftDistance>(33333U);
+        test_lshift<uint16_t, shiftDistance>(UINT16_MAX);
     }
 };
 
@@ -86,7 +99,7 @@ template <typename T, uint8_t b>
 static void test_rshift(T shiftValue) {
     char szMsg[128];
     sprintf(szMsg, "Shift: %" PRIu8 ", Type Width: %" PRIu8 ", Value: %" PRIi32, b, (uint8_t)sizeof(shiftValue), (int32_t) shiftValue);
-    TEST_ASSERT_EQUAL_MESSAGE((T)(shiftValue >> b), (rshift<b>(shiftValue)), szMsg);
+    TEST_ASSERT_EQUAL_MESSAGE((T)(shiftValue >> b), (rshift<b>(opaque(shiftValue))), szMsg);
 }
 
 
@@ -98,6 +111,10 @@ struct test_rshift_t<shiftDistance, false, false>
 {    
     static void run(void) {
         test_rshift<uint32_t, shiftDistance>(UINT16_MAX * 31UL);
+        test_rshift<int32_t, shiftDistance>(INT16_MAX * 31L);
+        test_rshift<int32_t, shiftDistance>(INT16_MIN * 31L);
+        test_rshift<int32_t, shiftDistance>(INT32_MIN);
+        test_rshift<int32_t, shiftDistance>(-1L);
     }
 };
 
@@ -107,6 +124,9 @@ struct test_rshift_t<shiftDistance, true, false>
     static void run(void) {
         test_rshift_t<shiftDistance, false, false>::run();
         test_rshift<uint16_t, shiftDistance>(33333U);
+        test_rshift<int16_t, shiftDistance>(-12345);
+        test_rshift<int16_t, shiftDistance>(12345);
+        test_rshift<int16_t, shiftDistance>(INT16_MIN);
     }
 };
 
@@ -158,6 +178,737 @@ void test_RShift()
     test_rshift<31U>();
 }
 
+template <typename T, uint8_t b> 
+static void test_shift64(T shiftValue) {
+    char szMsg[128];
+    sprintf(szMsg, "Shift: %" PRIu8 ", Value: 0x%08" PRIx32 "%08" PRIx32, b, (uint32_t)((uint64_t)shiftValue >> 32U), (uint32_t)shiftValue);
+    // Unity truncates integers to 32-bits, so compare in full here.
+    TEST_ASSERT_TRUE_MESSAGE((T)((uint64_t)shiftValue << b) == lshift<b>(opaque(shiftValue)), szMsg);
+    TEST_ASSERT_TRUE_MESSAGE((T)(shiftValue >> b) == rshift<b>(opaque(shiftValue)), szMsg);
+}
+
+template <uint8_t shiftDistance>
+struct test_shift64_t
+{
+    static void run(void) {
+        test_shift64<uint64_t, shiftDistance>(0xFEDCBA9876543210ULL);
+        test_shift64<uint64_t, shiftDistance>(UINT64_MAX);
+        test_shift64<int64_t, shiftDistance>(-0x0123456789ABCDEFLL);
+        test_shift64<int64_t, shiftDistance>(INT64_MAX);
+        test_shift64<int64_t, shiftDistance>(INT64_MIN);
+        test_shift64_t<shiftDistance-1U>::run();
+    }
+};
+
+template <>
+struct test_shift64_t<0U>
+{
+    static void run(void) {
+    }
+};
+
+static void test_Shift64()
+{
+    test_shift64_t<63U>::run();
+}
+
+#if defined(__UINT24_MAX__)
+template <uint8_t shiftDistance>
+struct test_shift24_t
+{
+    static void run(void) {
+        test_lshift<__uint24, shiftDistance>(0xFEDCBAUL);
+        test_rshift<__uint24, shiftDistance>(0xFEDCBAUL);
+        test_rshift<__int24, shiftDistance>(-1234567L);
+        test_rshift<__int24, shiftDistance>(1234567L);
+        test_shift24_t<shiftDistance-1U>::run();
+    }
+};
+
+template <>
+struct test_shift24_t<0U>
+{
+    static void run(void) {
+    }
+};
+#endif
+
+static void test_Shift24()
+{
+#if defined(__UINT24_MAX__)
+    test_shift24_t<23U>::run();
+#endif
+}
+
+static void test_runtime_Shift24()
+{
+#if defined(__UINT24_MAX__) && defined(AFS_RUNTIME_API)
+    const __uint24 uValue = 0xFEDCBAUL;
+    const __int24 sValue = -1234567L;
+    for (uint8_t shift=0; shift<24U; ++shift) {
+        TEST_ASSERT_EQUAL((__uint24)(uValue << shift), lshift(uValue, shift));
+        TEST_ASSERT_EQUAL((__uint24)(uValue >> shift), rshift(uValue, shift));
+        TEST_ASSERT_EQUAL((__int24)(sValue >> shift), rshift(sValue, shift));
+    }
+#endif
+}
+
+template <typename T>
+static T reference_rotl(T value, uint8_t distance) {
+    const uint8_t width = (uint8_t)(sizeof(T)*8U);
+    distance = (uint8_t)(distance % width);
+    return distance==0U ? value : (T)((value << distance) | (value >> (width-distance)));
+}
+
+template <uint8_t distance>
+static void test_rotate(void) {
+    const uint32_t value32 = UINT32_C(0xFEDCBA98);
+    TEST_ASSERT_EQUAL_UINT32(reference_rotl(value32, distance), rotl<distance>(opaque(value32)));
+    TEST_ASSERT_EQUAL_UINT32(reference_rotl(value32, (uint8_t)(32U-distance)), rotr<distance>(opaque(value32)));
+    const uint16_t value16 = 0xA5C3U;
+    TEST_ASSERT_EQUAL_UINT16(reference_rotl(value16, distance), rotl<distance>(opaque(value16)));
+    TEST_ASSERT_EQUAL_UINT16(reference_rotl(value16, (uint8_t)(32U-distance)), rotr<distance>(opaque(value16)));
+}
+
+template <uint8_t distance>
+struct test_rotate_t
+{
+    static void run(void) {
+        test_rotate<distance>();
+        test_rotate_t<distance-1U>::run();
+    }
+};
+
+template <>
+struct test_rotate_t<0U>
+{
+    static void run(void) {
+        test_rotate<0U>();
+    }
+};
+
+static void test_Rotate()
+{
+    // Distances are modulo the width, so check past it.
+    test_rotate_t<33U>::run();
+}
+
+static void test_runtime_Rotate()
+{
+#if defined(AFS_RUNTIME_API)
+    const uint32_t value32 = UINT32_C(0xFEDCBA98);
+    const uint16_t value16 = 0xA5C3U;
+    for (uint8_t distance=0; distance<40U; ++distance) {
+        TEST_ASSERT_EQUAL_UINT32(reference_rotl(value32, distance), rotl(value32, distance));
+        TEST_ASSERT_EQUAL_UINT32(reference_rotl(value32, (uint8_t)(32U-distance)), rotr(value32, distance));
+        TEST_ASSERT_EQUAL_UINT16(reference_rotl(value16, distance), rotl(value16, distance));
+        TEST_ASSERT_EQUAL_UINT16(reference_rotl(value16, (uint8_t)(32U-distance)), rotr(value16, distance));
+    }
+#endif
+}
+
+template <uint8_t pos, uint8_t len>
+static void test_bitfield(void) {
+    const uint32_t value = UINT32_C(0xFEDCBA98);
+    const uint32_t field = UINT32_C(0x13579BDF);
+    const uint32_t mask = UINT32_MAX >> (32U-len);
+    char szMsg[64];
+    sprintf(szMsg, "Pos: %" PRIu8 ", Len: %" PRIu8, pos, len);
+    TEST_ASSERT_TRUE_MESSAGE((sizeof(extract<pos, len>(value))*8U>=len), szMsg);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE((value >> pos) & mask, (extract<pos, len>(opaque(value))), szMsg);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE((value & ~(mask << pos)) | ((field & mask) << pos), (insert<pos, len>(opaque(value), opaque(field))), szMsg);
+}
+
+static void test_Bitfield()
+{
+    test_bitfield<0U, 1U>();
+    test_bitfield<0U, 8U>();
+    test_bitfield<3U, 5U>();
+    test_bitfield<4U, 8U>();
+    test_bitfield<7U, 2U>();
+    test_bitfield<6U, 12U>();
+    test_bitfield<8U, 16U>();
+    test_bitfield<12U, 4U>();
+    test_bitfield<9U, 15U>();
+    test_bitfield<5U, 20U>();
+    test_bitfield<13U, 19U>();
+    test_bitfield<20U, 12U>();
+    test_bitfield<24U, 8U>();
+    test_bitfield<31U, 1U>();
+    test_bitfield<1U, 31U>();
+    test_bitfield<0U, 32U>();
+}
+
+template <uint8_t distance>
+struct test_narrowing_rshift_t
+{
+    static void run(void) {
+        const uint32_t value = UINT32_C(0xFEDCBA98);
+        TEST_ASSERT_EQUAL_UINT16((uint16_t)(value >> distance), (rshift<distance, uint16_t>(opaque(value))));
+        TEST_ASSERT_EQUAL_UINT8((uint8_t)(value >> distance), (rshift<distance, uint8_t>(opaque(value))));
+        test_narrowing_rshift_t<distance-1U>::run();
+    }
+};
+
+template <>
+struct test_narrowing_rshift_t<0U>
+{
+    static void run(void) {
+        const uint32_t value = UINT32_C(0xFEDCBA98);
+        TEST_ASSERT_EQUAL_UINT16((uint16_t)value, (rshift<0U, uint16_t>(opaque(value))));
+        TEST_ASSERT_EQUAL_UINT8((uint8_t)value, (rshift<0U, uint8_t>(opaque(value))));
+    }
+};
+
+template <uint8_t distance>
+struct test_widening_lshift_t
+{
+    static void run(void) {
+        const uint8_t value8 = 0xA5U;
+        const uint16_t value16 = 0xFEDCU;
+        TEST_ASSERT_EQUAL_UINT32((uint32_t)value8 << distance, (lshift<distance, uint32_t>(opaque(value8))));
+        TEST_ASSERT_EQUAL_UINT32((uint32_t)value16 << distance, (lshift<distance, uint32_t>(opaque(value16))));
+#if defined(__UINT24_MAX__)
+        const __uint24 value24 = 0xFEDCBAUL;
+        TEST_ASSERT_EQUAL_UINT32((uint32_t)value24 << distance, (lshift<distance, uint32_t>(opaque(value24))));
+#endif
+        test_widening_lshift_t<distance-1U>::run();
+    }
+};
+
+template <>
+struct test_widening_lshift_t<0U>
+{
+    static void run(void) {
+        const uint16_t value16 = 0xFEDCU;
+        TEST_ASSERT_EQUAL_UINT32((uint32_t)value16, (lshift<0U, uint32_t>(opaque(value16))));
+    }
+};
+
+static void test_WideningLShift()
+{
+    test_widening_lshift_t<31U>::run();
+}
+
+static const uint16_t mul_values16[] = { 0U, 1U, 0x1234U, 0x8000U, 0xFEDCU, UINT16_MAX };
+static const uint32_t mul_values32[] = { 0U, 1U, UINT32_C(0x12345678), UINT32_C(0x80000000), UINT32_C(0xFEDCBA98), UINT32_MAX };
+static constexpr uint8_t mul_value_count = sizeof(mul_values16)/sizeof(mul_values16[0]);
+
+template <uint8_t shift>
+static void test_mul_shr32(void) {
+    for (uint8_t a=0; a<mul_value_count; ++a) {
+        for (uint8_t b=0; b<mul_value_count; ++b) {
+            TEST_ASSERT_EQUAL_UINT32((uint32_t)(((uint64_t)mul_values32[a] * mul_values16[b]) >> shift), mul_shr<shift>(opaque(mul_values32[a]), opaque(mul_values16[b])));
+        }
+    }
+}
+
+template <uint8_t shift>
+static void test_mul_shr(void) {
+    for (uint8_t a=0; a<mul_value_count; ++a) {
+        for (uint8_t b=0; b<mul_value_count; ++b) {
+            TEST_ASSERT_EQUAL_UINT32(((uint32_t)mul_values16[a] * mul_values16[b]) >> shift, mul_shr<shift>(opaque(mul_values16[a]), opaque(mul_values16[b])));
+        }
+    }
+    test_mul_shr32<shift>();
+}
+
+static void test_MulShr()
+{
+    test_mul_shr<0U>();
+    test_mul_shr<1U>();
+    test_mul_shr<7U>();
+    test_mul_shr<8U>();
+    test_mul_shr<10U>();
+    test_mul_shr<15U>();
+    test_mul_shr<16U>();
+    test_mul_shr<20U>();
+    test_mul_shr<24U>();
+    test_mul_shr<31U>();
+    test_mul_shr32<32U>();
+    test_mul_shr32<40U>();
+    test_mul_shr32<47U>();
+}
+
+// Fixed point results must match the hand written Q format expressions
+template <uint8_t F>
+static void test_ufixed32(void) {
+    typedef ufixed<(uint8_t)(32U-F), F> fixed_t;
+    for (uint8_t a=0; a<mul_value_count; ++a) {
+        const fixed_t fixedA = fixed_t::from_raw(opaque(mul_values32[a]));
+        TEST_ASSERT_EQUAL_UINT32(mul_values32[a] >> F, fixedA.to_int());
+        TEST_ASSERT_EQUAL_UINT32((uint32_t)((uint64_t)mul_values32[a] << F), fixed_t::from_int(opaque(mul_values32[a])).raw());
+        for (uint8_t b=0; b<mul_value_count; ++b) {
+            const fixed_t fixedB = fixed_t::from_raw(opaque(mul_values32[b]));
+            TEST_ASSERT_EQUAL_UINT32((uint32_t)(((uint64_t)mul_values32[a] * mul_values32[b]) >> F), (fixedA * fixedB).raw());
+            if (mul_values32[b]!=0U) {
+                TEST_ASSERT_EQUAL_UINT32((uint32_t)(((uint64_t)mul_values32[a] << F) / mul_values32[b]), (fixedA / fixedB).raw());
+            }
+        }
+    }
+}
+
+template <uint8_t F>
+static void test_ufixed16(void) {
+    typedef ufixed<(uint8_t)(16U-F), F> fixed_t;
+    for (uint8_t a=0; a<mul_value_count; ++a) {
+        const fixed_t fixedA = fixed_t::from_raw(opaque(mul_values16[a]));
+        TEST_ASSERT_EQUAL_UINT16(mul_values16[a] >> F, fixedA.to_int());
+        TEST_ASSERT_EQUAL_UINT16((uint16_t)((uint32_t)mul_values16[a] << F), fixed_t::from_int(opaque(mul_values16[a])).raw());
+        for (uint8_t b=0; b<mul_value_count; ++b) {
+            const fixed_t fixedB = fixed_t::from_raw(opaque(mul_values16[b]));
+            TEST_ASSERT_EQUAL_UINT16((uint16_t)(((uint32_t)mul_values16[a] * mul_values16[b]) >> F), (fixedA * fixedB).raw());
+            if (mul_values16[b]!=0U) {
+                TEST_ASSERT_EQUAL_UINT16((uint16_t)(((uint32_t)mul_values16[a] << F) / mul_values16[b]), (fixedA / fixedB).raw());
+            }
+        }
+    }
+}
+
+template <uint8_t F>
+static void test_sfixed32(void) {
+    typedef sfixed<(uint8_t)(32U-F), F> fixed_t;
+    for (uint8_t a=0; a<mul_value_count; ++a) {
+        const int32_t rawA = (int32_t)mul_values32[a];
+        const fixed_t fixedA = fixed_t::from_raw(opaque(rawA));
+        TEST_ASSERT_EQUAL_INT32(rawA >> F, fixedA.to_int());
+        for (uint8_t b=0; b<mul_value_count; ++b) {
+            const int32_t rawB = (int32_t)mul_values32[b];
+            const fixed_t fixedB = fixed_t::from_raw(opaque(rawB));
+            TEST_ASSERT_EQUAL_INT32((int32_t)(((int64_t)rawA * rawB) >> F), (fixedA * fixedB).raw());
+            if (rawB!=0) {
+                TEST_ASSERT_EQUAL_INT32((int32_t)(((int64_t)rawA * (INT64_C(1) << F)) / rawB), (fixedA / fixedB).raw());
+            }
+        }
+    }
+}
+
+template <uint8_t F>
+static void test_sfixed16(void) {
+    typedef sfixed<(uint8_t)(16U-F), F> fixed_t;
+    for (uint8_t a=0; a<mul_value_count; ++a) {
+        const int16_t rawA = (int16_t)mul_values16[a];
+        const fixed_t fixedA = fixed_t::from_raw(opaque(rawA));
+        TEST_ASSERT_EQUAL_INT16(rawA >> F, fixedA.to_int());
+        for (uint8_t b=0; b<mul_value_count; ++b) {
+            const int16_t rawB = (int16_t)mul_values16[b];
+            const fixed_t fixedB = fixed_t::from_raw(opaque(rawB));
+            TEST_ASSERT_EQUAL_INT16((int16_t)(((int32_t)rawA * rawB) >> F), (fixedA * fixedB).raw());
+            if (rawB!=0) {
+                TEST_ASSERT_EQUAL_INT16((int16_t)(((int32_t)rawA * (INT32_C(1) << F)) / rawB), (fixedA / fixedB).raw());
+            }
+        }
+    }
+}
+
+static void test_Fixed()
+{
+    test_ufixed32<0U>();
+    test_ufixed32<8U>();
+    test_ufixed32<12U>();
+    test_ufixed32<16U>();
+    test_ufixed32<20U>();
+    test_ufixed32<31U>();
+    test_ufixed16<0U>();
+    test_ufixed16<8U>();
+    test_ufixed16<12U>();
+    test_ufixed16<15U>();
+    test_sfixed32<8U>();
+    test_sfixed32<16U>();
+    test_sfixed32<24U>();
+    test_sfixed16<8U>();
+    test_sfixed16<12U>();
+
+    // Format changes
+    const uint32_t q16_16 = opaque(UINT32_C(0x12345678));
+    TEST_ASSERT_EQUAL_UINT32(q16_16 >> 8U, (ufixed<24U, 8U>(ufixed<16U, 16U>::from_raw(q16_16)).raw()));
+    TEST_ASSERT_EQUAL_UINT16((uint16_t)(q16_16 >> 8U), (ufixed<8U, 8U>(ufixed<16U, 16U>::from_raw(q16_16)).raw()));
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)0x5678U << 8U, (ufixed<16U, 16U>(ufixed<8U, 8U>::from_raw((uint16_t)q16_16)).raw()));
+    const int16_t q8_8 = opaque((int16_t)-0x1234);
+    TEST_ASSERT_EQUAL_INT32((int32_t)q8_8 * 256, (sfixed<16U, 16U>(sfixed<8U, 8U>::from_raw(q8_8)).raw()));
+    TEST_ASSERT_EQUAL_INT16(q8_8, (sfixed<8U, 8U>(sfixed<16U, 16U>(sfixed<8U, 8U>::from_raw(q8_8))).raw()));
+
+    // Floats
+    TEST_ASSERT_EQUAL_UINT32(UINT32_C(0x18000), (ufixed<16U, 16U>::from_float(opaque(1.5F)).raw()));
+    TEST_ASSERT_EQUAL_INT16(-0x0180, (sfixed<8U, 8U>::from_float(opaque(-1.5F)).raw()));
+    TEST_ASSERT_EQUAL_FLOAT(-1.5F, (sfixed<8U, 8U>::from_raw(opaque((int16_t)-0x0180)).to_float()));
+}
+
+template <typename T, uint8_t b>
+static void test_fast_int(T value) {
+    const T shifted = (T)((uint32_t)value << b);
+    const fast_int_t<T> fast = opaque(value);
+    TEST_ASSERT_EQUAL_HEX32(shifted, (T)(fast << shift_constant<b>()));
+    TEST_ASSERT_EQUAL_HEX32(value >> b, (T)(fast >> shift_constant<b>()));
+    TEST_ASSERT_EQUAL_HEX32(shifted, (T)(fast << opaque(b)));
+    TEST_ASSERT_EQUAL_HEX32(value >> b, (T)(fast >> opaque(b)));
+
+    fast_int_t<T> assigned = fast;
+    assigned <<= shift_constant<b>();
+    TEST_ASSERT_EQUAL_HEX32(shifted, (T)assigned);
+    assigned = fast;
+    assigned >>= opaque(b);
+    TEST_ASSERT_EQUAL_HEX32(value >> b, (T)assigned);
+}
+
+template <uint8_t b>
+static void test_fast_int(void) {
+    test_fast_int<uint32_t, b>(UINT32_C(0xFEDCBA98));
+    test_fast_int<int32_t, b>(INT32_C(-19088744));
+    test_fast_int<int32_t, b>(INT32_C(19088744));
+}
+
+static void test_FastInt()
+{
+    test_fast_int<0U>();
+    test_fast_int<1U>();
+    test_fast_int<7U>();
+    test_fast_int<8U>();
+    test_fast_int<10U>();
+    test_fast_int<16U>();
+    test_fast_int<21U>();
+    test_fast_int<31U>();
+
+    // Everything else behaves as the wrapped integer
+    fast_u32 value = opaque(UINT32_C(1000));
+    value += 24U;
+    TEST_ASSERT_EQUAL_UINT32(UINT32_C(1024), value);
+    value = (value << shift_constant<2U>()) / 3U;
+    TEST_ASSERT_EQUAL_UINT32(UINT32_C(1365), value);
+    ++value;
+    value |= 1U;
+    TEST_ASSERT_EQUAL_UINT32(UINT32_C(1367), value);
+    fast_i32 signedValue = opaque(INT32_C(-1024));
+    signedValue >>= shift_constant<4U>();
+    TEST_ASSERT_EQUAL_INT32(INT32_C(-64), signedValue);
+    signedValue *= -2;
+    TEST_ASSERT_EQUAL_INT32(INT32_C(128), signedValue);
+}
+
+// Including the values where a + (1<<(b-1)) overflows
+static const uint32_t round_values[] = { 0U, 1U, 2U, 3U, UINT32_C(0x12345678), UINT32_C(0x7FFFFFFF), UINT32_C(0x80000000), UINT32_C(0x80000001), UINT32_C(0xFEDCBA98), UINT32_MAX };
+
+template <uint8_t b>
+static void test_rshift_round(uint32_t value) {
+    const uint32_t half = UINT32_C(1) << (b-1U);
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)(((uint64_t)value + half) >> b), rshift_round<b>(opaque(value)));
+    const int32_t signedValue = (int32_t)value;
+    TEST_ASSERT_EQUAL_INT32((int32_t)(((int64_t)signedValue + half) >> b), rshift_round<b>(opaque(signedValue)));
+    TEST_ASSERT_EQUAL_INT32((int32_t)((int64_t)signedValue / (INT64_C(1) << b)), sdiv_pow2<b>(opaque(signedValue)));
+}
+
+template <uint8_t b>
+static void test_rshift_round(void) {
+    for (uint8_t index=0; index<sizeof(round_values)/sizeof(round_values[0]); ++index) {
+        test_rshift_round<b>(round_values[index]);
+    }
+    // Halves, which round up, and either side of them
+    const uint32_t half = UINT32_C(1) << (b-1U);
+    test_rshift_round<b>(half-1U);
+    test_rshift_round<b>(half);
+    test_rshift_round<b>(half+1U);
+    test_rshift_round<b>(3U*half);
+    test_rshift_round<b>(-half);
+    test_rshift_round<b>(-(3U*half));
+}
+
+static void test_RShiftRound()
+{
+    test_rshift_round<1U>();
+    test_rshift_round<2U>();
+    test_rshift_round<7U>();
+    test_rshift_round<8U>();
+    test_rshift_round<9U>();
+    test_rshift_round<12U>();
+    test_rshift_round<16U>();
+    test_rshift_round<17U>();
+    test_rshift_round<23U>();
+    test_rshift_round<24U>();
+    test_rshift_round<30U>();
+    test_rshift_round<31U>();
+}
+
+template <uint8_t b>
+static void test_lshift_sat(uint32_t value) {
+    const uint64_t shifted = (uint64_t)value << b;
+    const bool overflows = shifted>UINT32_MAX;
+    uint32_t result;
+    TEST_ASSERT_EQUAL_UINT32(overflows ? UINT32_MAX : (uint32_t)shifted, lshift_sat<b>(opaque(value)));
+    TEST_ASSERT_EQUAL(overflows, lshift_overflows<b>(opaque(value), result));
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)shifted, result);
+}
+
+template <uint8_t b>
+static void test_lshift_sat(int32_t value) {
+    const int64_t shifted = (int64_t)value * (INT64_C(1) << b);
+    const bool overflows = shifted>INT32_MAX || shifted<INT32_MIN;
+    int32_t result;
+    TEST_ASSERT_EQUAL_INT32(overflows ? (value<0 ? INT32_MIN : INT32_MAX) : (int32_t)shifted, lshift_sat<b>(opaque(value)));
+    TEST_ASSERT_EQUAL(overflows, lshift_overflows<b>(opaque(value), result));
+    TEST_ASSERT_EQUAL_INT32((int32_t)(uint32_t)shifted, result);
+}
+
+template <uint8_t b>
+static void test_lshift_sat(void) {
+    // Either side of the largest value that doesn't overflow
+    const uint32_t max = UINT32_MAX >> b;
+    test_lshift_sat<b>(UINT32_C(0));
+    test_lshift_sat<b>(max-1U);
+    test_lshift_sat<b>(max);
+    test_lshift_sat<b>(max+1U);
+    test_lshift_sat<b>(UINT32_MAX);
+    const int32_t signedMax = INT32_MAX >> b;
+    test_lshift_sat<b>(INT32_C(0));
+    test_lshift_sat<b>(INT32_C(-1));
+    test_lshift_sat<b>(signedMax);
+    test_lshift_sat<b>(signedMax+1);
+    test_lshift_sat<b>(-signedMax-1);
+    test_lshift_sat<b>(-signedMax-2);
+    test_lshift_sat<b>(INT32_MAX);
+    test_lshift_sat<b>(INT32_MIN);
+}
+
+static void test_LShiftSat()
+{
+    test_lshift_sat<1U>();
+    test_lshift_sat<3U>();
+    test_lshift_sat<8U>();
+    test_lshift_sat<10U>();
+    test_lshift_sat<16U>();
+    test_lshift_sat<20U>();
+    test_lshift_sat<24U>();
+    test_lshift_sat<31U>();
+}
+
+template <uint8_t b>
+static void test_shift_carry(void) {
+    for (uint8_t index=0; index<sizeof(round_values)/sizeof(round_values[0]); ++index) {
+        const uint32_t value = round_values[index];
+        uint32_t carry;
+        TEST_ASSERT_EQUAL_UINT32(value << b, lshift_carry<b>(opaque(value), carry));
+        TEST_ASSERT_EQUAL_UINT32(value >> (32U-b), carry);
+        TEST_ASSERT_EQUAL_UINT32(value >> b, rshift_carry<b>(opaque(value), carry));
+        TEST_ASSERT_EQUAL_UINT32(value << (32U-b), carry);
+    }
+
+    // A 96-bit value, least significant limb first
+    const uint64_t lo = UINT64_C(0xFEDCBA9876543210);
+    const uint32_t hi = UINT32_C(0x89ABCDEF);
+    uint32_t limbs[] = { (uint32_t)lo, (uint32_t)(lo >> 32U), hi };
+    TEST_ASSERT_EQUAL_UINT32(hi >> (32U-b), lshift_array<b>(limbs, 3U));
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)(lo << b), limbs[0]);
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)((lo << b) >> 32U), limbs[1]);
+    TEST_ASSERT_EQUAL_UINT32((hi << b) | (uint32_t)(lo >> (64U-b)), limbs[2]);
+    TEST_ASSERT_EQUAL_UINT32(0U, rshift_array<b>(limbs, 3U));
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)lo, limbs[0]);
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)(lo >> 32U), limbs[1]);
+    TEST_ASSERT_EQUAL_UINT32(hi & (UINT32_MAX >> b), limbs[2]);
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)lo << (32U-b), rshift_array<b>(limbs, 1U));
+}
+
+static void test_ShiftCarry()
+{
+    test_shift_carry<1U>();
+    test_shift_carry<3U>();
+    test_shift_carry<5U>();
+    test_shift_carry<7U>();
+    test_shift_carry<8U>();
+    test_shift_carry<12U>();
+    test_shift_carry<13U>();
+    test_shift_carry<16U>();
+    test_shift_carry<22U>();
+    test_shift_carry<24U>();
+    test_shift_carry<29U>();
+    test_shift_carry<31U>();
+}
+
+template <uint8_t b>
+static void test_shift_n(void) {
+    static constexpr uint8_t count = sizeof(round_values)/sizeof(round_values[0]);
+    // Every length up to count: covers all the remainders of the unrolled loop
+    for (uint8_t length=0; length<=count; ++length) {
+        uint32_t buffer[count+1U];
+        for (uint8_t index=0; index<count; ++index) {
+            buffer[index] = round_values[index];
+        }
+        // Past the end: must not be touched
+        buffer[length] = UINT32_C(0x12345678);
+
+        rshift_n<b>(buffer, opaque((size_t)length));
+        for (uint8_t index=0; index<length; ++index) {
+            TEST_ASSERT_EQUAL_UINT32(round_values[index] >> b, buffer[index]);
+        }
+        lshift_n<b>(buffer, opaque((size_t)length));
+        for (uint8_t index=0; index<length; ++index) {
+            TEST_ASSERT_EQUAL_UINT32((round_values[index] >> b) << b, buffer[index]);
+        }
+        TEST_ASSERT_EQUAL_UINT32(UINT32_C(0x12345678), buffer[length]);
+    }
+}
+
+static void test_ShiftN()
+{
+    test_shift_n<1U>();
+    test_shift_n<4U>();
+    test_shift_n<7U>();
+    test_shift_n<8U>();
+    test_shift_n<10U>();
+    test_shift_n<16U>();
+    test_shift_n<21U>();
+    test_shift_n<31U>();
+}
+
+template <uint8_t b>
+static void test_memory_shift(void) {
+    // Volatile, so the loads can't be folded away
+    static volatile uint32_t value;
+    for (uint8_t index=0; index<sizeof(round_values)/sizeof(round_values[0]); ++index) {
+        value = round_values[index];
+        TEST_ASSERT_EQUAL_UINT32(round_values[index] >> b, rshift<b>(&value));
+        TEST_ASSERT_EQUAL_UINT32(round_values[index] << b, lshift<b>(&value));
+    }
+}
+
+static void test_MemoryShift()
+{
+    test_memory_shift<1U>();
+    test_memory_shift<7U>();
+    test_memory_shift<8U>();
+    test_memory_shift<11U>();
+    test_memory_shift<16U>();
+    test_memory_shift<18U>();
+    test_memory_shift<24U>();
+    test_memory_shift<31U>();
+}
+
+template <uint8_t b>
+static void test_atomic_shift(void) {
+    static volatile uint32_t value;
+    for (uint8_t index=0; index<sizeof(round_values)/sizeof(round_values[0]); ++index) {
+        value = round_values[index];
+        TEST_ASSERT_EQUAL_UINT32(round_values[index] >> b, atomic_rshift_assign<b>(value));
+        TEST_ASSERT_EQUAL_UINT32(round_values[index] >> b, value);
+        TEST_ASSERT_EQUAL_UINT32((round_values[index] >> b) << b, atomic_lshift_assign<b>(value));
+        TEST_ASSERT_EQUAL_UINT32((round_values[index] >> b) << b, value);
+    }
+}
+
+static void test_AtomicShift()
+{
+    test_atomic_shift<1U>();
+    test_atomic_shift<4U>();
+    test_atomic_shift<8U>();
+    test_atomic_shift<13U>();
+    test_atomic_shift<16U>();
+    test_atomic_shift<24U>();
+    test_atomic_shift<31U>();
+}
+
+static void test_clz(uint32_t value) {
+    uint8_t leading = 0U;
+    while (leading<32U && (value & (UINT32_C(0x80000000) >> leading))==0U) {
+        ++leading;
+    }
+    uint8_t trailing = 0U;
+    while (trailing<32U && (value & (UINT32_C(1) << trailing))==0U) {
+        ++trailing;
+    }
+    TEST_ASSERT_EQUAL_UINT8(leading, clz32(opaque(value)));
+    TEST_ASSERT_EQUAL_UINT8(trailing, ctz32(opaque(value)));
+
+    normalized_t normalized = normalize(opaque(value));
+    TEST_ASSERT_EQUAL_UINT8(leading, normalized.exponent);
+    TEST_ASSERT_EQUAL_UINT32(leading<32U ? value << leading : 0U, normalized.value);
+}
+
+static void test_Clz()
+{
+    for (uint8_t index=0; index<sizeof(round_values)/sizeof(round_values[0]); ++index) {
+        test_clz(round_values[index]);
+    }
+    for (uint8_t bit=0; bit<32U; ++bit) {
+        test_clz(UINT32_C(1) << bit);
+        test_clz((UINT32_C(1) << bit) | 1U);
+        test_clz(UINT32_MAX >> bit);
+        test_clz(UINT32_MAX << bit);
+    }
+}
+
+static void test_NarrowingRShift()
+{
+    test_narrowing_rshift_t<31U>::run();
+}
+
+// The shifts must be usable in constant expressions
+static_assert(lshift<10U>(UINT32_C(3))==UINT32_C(3072), "lshift<uint32_t> is not constexpr");
+static_assert(rshift<10U>(UINT32_C(3072))==UINT32_C(3), "rshift<uint32_t> is not constexpr");
+static_assert(rshift<10U>(INT32_C(-3072))==INT32_C(-3), "rshift<int32_t> is not constexpr");
+static_assert(lshift<10U>(INT32_C(-3))==INT32_C(-3072), "lshift<int32_t> is not constexpr");
+static_assert(lshift<40U>(UINT64_C(3))==UINT64_C(3298534883328), "lshift<uint64_t> is not constexpr");
+static_assert(lshift<40U>(INT64_C(3))==INT64_C(3298534883328), "lshift<int64_t> is not constexpr");
+static_assert(rshift<40U>(UINT64_C(3298534883328))==UINT64_C(3), "rshift<uint64_t> is not constexpr");
+static_assert(rshift<40U>(INT64_C(-3298534883328))==INT64_C(-3), "rshift<int64_t> is not constexpr");
+static_assert(lshift<10U>((uint16_t)3U)==3072U, "lshift<uint16_t> is not constexpr");
+static_assert(lshift<10U>((int16_t)3)==3072, "lshift<int16_t> is not constexpr");
+static_assert(rshift<10U>((uint16_t)3072U)==3U, "rshift<uint16_t> is not constexpr");
+static_assert(rshift<10U>((int16_t)-3072)==-3, "rshift<int16_t> is not constexpr");
+static_assert(lshift<4U>((uint8_t)3U)==48U, "lshift<uint8_t> is not constexpr");
+static_assert(rshift<4U>((uint8_t)48U)==3U, "rshift<uint8_t> is not constexpr");
+static_assert(rotl<8U>(UINT32_C(0x12345678))==UINT32_C(0x34567812), "rotl<uint32_t> is not constexpr");
+static_assert(rotr<8U>(UINT32_C(0x12345678))==UINT32_C(0x78123456), "rotr<uint32_t> is not constexpr");
+static_assert(rotl<4U>((uint16_t)0x1234U)==0x2341U, "rotl<uint16_t> is not constexpr");
+static_assert(rotr<4U>((uint16_t)0x1234U)==0x4123U, "rotr<uint16_t> is not constexpr");
+static_assert(extract<4U, 8U>(UINT32_C(0x12345678))==0x67U, "extract is not constexpr");
+static_assert(insert<4U, 8U>(UINT32_C(0x12345678), 0xABU)==UINT32_C(0x12345AB8), "insert is not constexpr");
+static_assert(rshift<12U, uint16_t>(UINT32_C(0x12345678))==0x2345U, "rshift<b, uint16_t> is not constexpr");
+static_assert(lshift<10U, uint32_t>((uint16_t)0x1234U)==UINT32_C(0x48D000), "lshift<b, uint32_t> is not constexpr");
+static_assert(mul_shr<8U>((uint16_t)0x1234U, (uint16_t)0x0200U)==UINT32_C(0x2468), "mul_shr is not constexpr");
+static_assert((ufixed<16U, 16U>::from_int(3U) * ufixed<16U, 16U>::from_float(1.5F)).to_int()==4U, "ufixed is not constexpr");
+static_assert((sfixed<8U, 8U>::from_int(-3) * sfixed<8U, 8U>::from_float(1.5F)).to_int()==-5, "sfixed is not constexpr");
+static_assert((ufixed<24U, 8U>(ufixed<16U, 16U>::from_raw(UINT32_C(0x12345678)))).raw()==UINT32_C(0x123456), "fixed point format change is not constexpr");
+static_assert(rshift_round<4U>(UINT32_C(24))==2U, "rshift_round<uint32_t> is not constexpr");
+static_assert(rshift_round<4U>(INT32_C(-24))==-1, "rshift_round<int32_t> is not constexpr");
+static_assert(sdiv_pow2<4U>(INT32_C(-24))==-1, "sdiv_pow2 is not constexpr");
+static_assert(lshift_sat<4U>(UINT32_C(0x10000000))==UINT32_MAX, "lshift_sat<uint32_t> is not constexpr");
+static_assert(lshift_sat<4U>(INT32_C(-0x08000001))==INT32_MIN, "lshift_sat<int32_t> is not constexpr");
+// extract returns the narrowest type that will hold the field
+static_assert(sizeof(extract<3U, 5U>(0U))==1U, "extract<3, 5> should be uint8_t");
+static_assert(sizeof(extract<6U, 12U>(0U))==2U, "extract<6, 12> should be uint16_t");
+static_assert(sizeof(extract<1U, 31U>(0U))==4U, "extract<1, 31> should be uint32_t");
+#if defined(__UINT24_MAX__)
+static_assert(lshift<10U>((__uint24)3U)==3072U, "lshift<__uint24> is not constexpr");
+static_assert(lshift<10U>((__int24)3)==3072, "lshift<__int24> is not constexpr");
+static_assert(rshift<10U>((__uint24)3072U)==3U, "rshift<__uint24> is not constexpr");
+static_assert(rshift<10U>((__int24)-3072)==-3, "rshift<__int24> is not constexpr");
+#endif
+
+static void test_constant_folding()
+{
+#if defined(AFS_USE_OPTIMIZED_SHIFTS) && defined(__OPTIMIZE__)
+    // A constant value (even one that only becomes constant once inlined) must
+    // be left to the compiler, so the result is a constant too.
+    const uint32_t value = 12345U;
+    uint32_t folded32 = lshift<10U>(value);
+    TEST_ASSERT_TRUE(__builtin_constant_p(folded32));
+    folded32 = rshift<7U>(folded32);
+    TEST_ASSERT_TRUE(__builtin_constant_p(folded32));
+    int32_t foldedS32 = rshift<13U>(-(int32_t)value);
+    TEST_ASSERT_TRUE(__builtin_constant_p(foldedS32));
+    uint64_t folded64 = rshift<37U>(lshift<45U>((uint64_t)value));
+    TEST_ASSERT_TRUE(__builtin_constant_p(folded64));
+    uint16_t folded16 = lshift<5U>((uint16_t)value);
+    TEST_ASSERT_TRUE(__builtin_constant_p(folded16));
+
+    // Otherwise the optimized shift is used, which the compiler can't see into.
+    uint32_t runtime32 = lshift<10U>(opaque(value));
+    TEST_ASSERT_FALSE(__builtin_constant_p(runtime32));
+    TEST_ASSERT_EQUAL_UINT32(folded32 << 7U, runtime32);
+    uint16_t runtime16 = lshift<5U>(opaque((uint16_t)value));
+    TEST_ASSERT_FALSE(__builtin_constant_p(runtime16));
+    TEST_ASSERT_EQUAL_UINT16(folded16, runtime16);
+#endif
+}
+
 #if defined(AFS_USE_OPTIMIZED_SHIFTS)
 
 static uint32_t seedValue;
@@ -233,77 +984,854 @@ static void optimizedTestLShift(uint8_t index, uint32_t &checkSum) {
     PERF_TEST_FUN_BODY(PERF_OPTIMIZED_LSHIFT)
 };
 
-#endif 
+// 64-bit shifts are all optimized, so every distance is exercised.
+#define PERF_TEST64_FUN_BODY(shift_op) \
+    if (index==0U) { \
+        if (checkSum==0U) { checkSum = seedValue; randomSeed(seedValue); } \
+        shiftDistance = (uint8_t)random(1, 64); \
+    } else { \
+        shift_op(shiftDistance, 1U) shift_op(shiftDistance, 2U) shift_op(shiftDistance, 3U) shift_op(shiftDistance, 4U) \
+        shift_op(shiftDistance, 5U) shift_op(shiftDistance, 6U) shift_op(shiftDistance, 7U) shift_op(shiftDistance, 8U) \
+        shift_op(shiftDistance, 9U) shift_op(shiftDistance, 10U) shift_op(shiftDistance, 11U) shift_op(shiftDistance, 12U) \
+        shift_op(shiftDistance, 13U) shift_op(shiftDistance, 14U) shift_op(shiftDistance, 15U) shift_op(shiftDistance, 16U) \
+        shift_op(shiftDistance, 17U) shift_op(shiftDistance, 18U) shift_op(shiftDistance, 19U) shift_op(shiftDistance, 20U) \
+        shift_op(shiftDistance, 21U) shift_op(shiftDistance, 22U) shift_op(shiftDistance, 23U) shift_op(shiftDistance, 24U) \
+        shift_op(shiftDistance, 25U) shift_op(shiftDistance, 26U) shift_op(shiftDistance, 27U) shift_op(shiftDistance, 28U) \
+        shift_op(shiftDistance, 29U) shift_op(shiftDistance, 30U) shift_op(shiftDistance, 31U) shift_op(shiftDistance, 32U) \
+        shift_op(shiftDistance, 33U) shift_op(shiftDistance, 34U) shift_op(shiftDistance, 35U) shift_op(shiftDistance, 36U) \
+        shift_op(shiftDistance, 37U) shift_op(shiftDistance, 38U) shift_op(shiftDistance, 39U) shift_op(shiftDistance, 40U) \
+        shift_op(shiftDistance, 41U) shift_op(shiftDistance, 42U) shift_op(shiftDistance, 43U) shift_op(shiftDistance, 44U) \
+        shift_op(shiftDistance, 45U) shift_op(shiftDistance, 46U) shift_op(shiftDistance, 47U) shift_op(shiftDistance, 48U) \
+        shift_op(shiftDistance, 49U) shift_op(shiftDistance, 50U) shift_op(shiftDistance, 51U) shift_op(shiftDistance, 52U) \
+        shift_op(shiftDistance, 53U) shift_op(shiftDistance, 54U) shift_op(shiftDistance, 55U) shift_op(shiftDistance, 56U) \
+        shift_op(shiftDistance, 57U) shift_op(shiftDistance, 58U) shift_op(shiftDistance, 59U) shift_op(shiftDistance, 60U) \
+        shift_op(shiftDistance, 61U) shift_op(shiftDistance, 62U) shift_op(shiftDistance, 63U) \
+    }
 
-static void test_rshift_perf(void) {
-#if defined(AFS_USE_OPTIMIZED_SHIFTS)
-    seedValue = rand();
+static void nativeTestRShift64(uint8_t index, uint64_t &checkSum) { 
+    PERF_TEST64_FUN_BODY(PERF_NATIVE_RSHIFT)
+};
 
-    auto comparison = compare_executiontime<uint8_t, uint32_t>(iters, start_index, end_index, step, nativeTestRShift, optimizedTestRShift);
-    
-    MESSAGE_TIMERS(comparison.timeA.timer, comparison.timeB.timer);
-    TEST_ASSERT_EQUAL(comparison.timeA.result, comparison.timeB.result);
+static void optimizedTestRShift64(uint8_t index, uint64_t &checkSum) {
+    PERF_TEST64_FUN_BODY(PERF_OPTIMIZED_RSHIFT)
+};
 
-    TEST_ASSERT_LESS_THAN(comparison.timeA.timer.duration_micros(), comparison.timeB.timer.duration_micros());
-#endif
-}
+static void nativeTestLShift64(uint8_t index, uint64_t &checkSum) { 
+    PERF_TEST64_FUN_BODY(PERF_NATIVE_LSHIFT)
+};
 
+static void optimizedTestLShift64(uint8_t index, uint64_t &checkSum) {
+    PERF_TEST64_FUN_BODY(PERF_OPTIMIZED_LSHIFT)
+};
 
-static void test_lshift_perf(void) {
-#if defined(AFS_USE_OPTIMIZED_SHIFTS)
-    seedValue = rand();
+#define PERF_NATIVE_SRSHIFT64(index, distance) if ((index)==(distance)) { checkSum += (uint64_t)((int64_t)checkSum >> (distance)); }
+#define PERF_OPTIMIZED_SRSHIFT64(index, distance) if ((index)==(distance)) { checkSum += (uint64_t)rshift<distance>((int64_t)checkSum); }
 
-    auto comparison = compare_executiontime<uint8_t, uint32_t>(iters, start_index, end_index, step, nativeTestLShift, optimizedTestLShift);
-    
-    MESSAGE_TIMERS(comparison.timeA.timer, comparison.timeB.timer);
-    TEST_ASSERT_EQUAL(comparison.timeA.result, comparison.timeB.result);
+static void nativeTestSRShift64(uint8_t index, uint64_t &checkSum) { 
+    PERF_TEST64_FUN_BODY(PERF_NATIVE_SRSHIFT64)
+};
 
-    TEST_ASSERT_LESS_THAN(comparison.timeA.timer.duration_micros(), comparison.timeB.timer.duration_micros());
-#endif
-}
+static void optimizedTestSRShift64(uint8_t index, uint64_t &checkSum) {
+    PERF_TEST64_FUN_BODY(PERF_OPTIMIZED_SRSHIFT64)
+};
 
-// The macros below are used to ensure the performance test functions
-// have the same number of operations
-//
-// So we are comparing apples-to-apples
+#define PERF_TEST16_FUN_BODY(shift_op) \
+    if (index==0U) { \
+        if (checkSum==0U) { checkSum = (uint16_t)seedValue; randomSeed(seedValue); } \
+        shiftDistance = (uint8_t)random(3, 16); \
+    } else { \
+        shift_op(shiftDistance, 3U) shift_op(shiftDistance, 4U) shift_op(shiftDistance, 5U) \
+        shift_op(shiftDistance, 6U) shift_op(shiftDistance, 7U) shift_op(shiftDistance, 9U) \
+        shift_op(shiftDistance, 10U) shift_op(shiftDistance, 11U) shift_op(shiftDistance, 12U) \
+        shift_op(shiftDistance, 13U) shift_op(shiftDistance, 14U) shift_op(shiftDistance, 15U) \
+    }
 
-#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+// Integer promotion means 16-bit results need explicit narrowing
+#define PERF_NATIVE_SHIFT16(index, distance, op) if ((index)==(distance)) { checkSum = (uint16_t)(checkSum + (uint16_t)(checkSum op (distance))); }
+#define PERF_NATIVE_RSHIFT16(index, distance) PERF_NATIVE_SHIFT16((index), (distance), >>)
+#define PERF_NATIVE_LSHIFT16(index, distance) PERF_NATIVE_SHIFT16((index), (distance), <<)
 
-#define PERF_RT_NATIVE_RSHIFT(checkSum, shiftDistance) (checkSum) += (checkSum) >> (shiftDistance);
-#define PERF_RT_NATIVE_LSHIFT(checkSum, shiftDistance) (checkSum) += (checkSum) << (shiftDistance);
+#define PERF_OPTIMIZED_SHIFT16(index, distance, op) if ((index)==(distance)) { checkSum = (uint16_t)(checkSum + op<distance>(checkSum)); }
+#define PERF_OPTIMIZED_RSHIFT16(index, distance) PERF_OPTIMIZED_SHIFT16((index), (distance), rshift)
+#define PERF_OPTIMIZED_LSHIFT16(index, distance) PERF_OPTIMIZED_SHIFT16((index), (distance), lshift)
 
-#define PERF_RT_OPTIMIZED_RSHIFT(checkSum, shiftDistance) (checkSum) += rshift((checkSum), (shiftDistance));
-#define PERF_RT_OPTIMIZED_LSHIFT(checkSum, shiftDistance) (checkSum) += lshift((checkSum), (shiftDistance));
+#define PERF_NATIVE_SRSHIFT16(index, distance) if ((index)==(distance)) { checkSum = (uint16_t)(checkSum + (uint16_t)((int16_t)checkSum >> (distance))); }
+#define PERF_OPTIMIZED_SRSHIFT16(index, distance) if ((index)==(distance)) { checkSum = (uint16_t)(checkSum + (uint16_t)rshift<distance>((int16_t)checkSum)); }
 
-// Randomness here is all about ensuring that the compiler doesn't optimize away the shifts
-// (which it won't do in normal operaton when the shift operands are unknown at compile time.)
-#define PERF_RT_TEST_FUN_BODY(shift_op) \
-    if (index==0U) { \
-        if (checkSum==0U) { checkSum = seedValue; randomSeed(seedValue); } \
-        shiftDistance = (uint8_t)random(1, 32); \
-    } else { \
-        shift_op(checkSum, shiftDistance); \
-    }
+static void nativeTestRShift16(uint8_t index, uint16_t &checkSum) { 
+    PERF_TEST16_FUN_BODY(PERF_NATIVE_RSHIFT16)
+};
 
-static inline void rtNativeTestRShift(uint8_t index, uint32_t &checkSum) { 
-    PERF_RT_TEST_FUN_BODY(PERF_RT_NATIVE_RSHIFT)
+static void optimizedTestRShift16(uint8_t index, uint16_t &checkSum) {
+    PERF_TEST16_FUN_BODY(PERF_OPTIMIZED_RSHIFT16)
 };
 
-static inline void rtOptimizedTestRShift(uint8_t index, uint32_t &checkSum) {
-    PERF_RT_TEST_FUN_BODY(PERF_RT_OPTIMIZED_RSHIFT)
+static void nativeTestSRShift16(uint8_t index, uint16_t &checkSum) { 
+    PERF_TEST16_FUN_BODY(PERF_NATIVE_SRSHIFT16)
 };
 
-static inline void rtNativeTestLShift(uint8_t index, uint32_t &checkSum) { 
-    PERF_RT_TEST_FUN_BODY(PERF_RT_NATIVE_LSHIFT)
+static void optimizedTestSRShift16(uint8_t index, uint16_t &checkSum) {
+    PERF_TEST16_FUN_BODY(PERF_OPTIMIZED_SRSHIFT16)
 };
 
-static inline void rtOptimizedTestLShift(uint8_t index, uint32_t &checkSum) {
-    PERF_RT_TEST_FUN_BODY(PERF_RT_OPTIMIZED_LSHIFT)
+static void nativeTestLShift16(uint8_t index, uint16_t &checkSum) { 
+    PERF_TEST16_FUN_BODY(PERF_NATIVE_LSHIFT16)
 };
 
-#endif
+static void optimizedTestLShift16(uint8_t index, uint16_t &checkSum) {
+    PERF_TEST16_FUN_BODY(PERF_OPTIMIZED_LSHIFT16)
+};
 
-static void test_runtime_rshift_perf(void) {
+// Native rotates are the usual shift & or idiom
+#define PERF_NATIVE_ROTL(index, distance) if ((index)==(distance)) { checkSum += (checkSum << (distance)) | (checkSum >> (32U-(distance))); }
+#define PERF_OPTIMIZED_ROTL(index, distance) PERF_OPTIMIZED_SHIFT((index), (distance), rotl)
+#define PERF_NATIVE_ROTL16(index, distance) if ((index)==(distance)) { checkSum = (uint16_t)(checkSum + (uint16_t)((checkSum << (distance)) | (checkSum >> (16U-(distance))))); }
+#define PERF_OPTIMIZED_ROTL16(index, distance) PERF_OPTIMIZED_SHIFT16((index), (distance), rotl)
+
+// Extract the byte (or less) at the distance
+#define PERF_EXTRACT_LEN(distance) ((distance)>24U ? 32U-(distance) : 8U)
+#define PERF_NATIVE_EXTRACT(index, distance) if ((index)==(distance)) { checkSum += (checkSum >> (distance)) & (UINT32_MAX >> (32U-PERF_EXTRACT_LEN(distance))); }
+#define PERF_OPTIMIZED_EXTRACT(index, distance) if ((index)==(distance)) { checkSum += extract<(distance), PERF_EXTRACT_LEN(distance)>(checkSum); }
+
+static void nativeTestExtract(uint8_t index, uint32_t &checkSum) { 
+    PERF_TEST_FUN_BODY(PERF_NATIVE_EXTRACT)
+};
+
+static void optimizedTestExtract(uint8_t index, uint32_t &checkSum) {
+    PERF_TEST_FUN_BODY(PERF_OPTIMIZED_EXTRACT)
+};
+
+// Narrowing shifts, against narrowing the full 32-bit shift
+#define PERF_TRUNCATED_RSHIFT16(index, distance) if ((index)==(distance)) { checkSum += (uint16_t)rshift<distance>(checkSum); }
+#define PERF_NARROWING_RSHIFT16(index, distance) if ((index)==(distance)) { checkSum += rshift<distance, uint16_t>(checkSum); }
+#define PERF_TRUNCATED_RSHIFT8(index, distance) if ((index)==(distance)) { checkSum += (uint8_t)rshift<distance>(checkSum); }
+#define PERF_NARROWING_RSHIFT8(index, distance) if ((index)==(distance)) { checkSum += rshift<distance, uint8_t>(checkSum); }
+
+static void truncatedTestRShift16(uint8_t index, uint32_t &checkSum) { 
+    PERF_TEST_FUN_BODY(PERF_TRUNCATED_RSHIFT16)
+};
+
+static void narrowingTestRShift16(uint8_t index, uint32_t &checkSum) {
+    PERF_TEST_FUN_BODY(PERF_NARROWING_RSHIFT16)
+};
+
+static void truncatedTestRShift8(uint8_t index, uint32_t &checkSum) { 
+    PERF_TEST_FUN_BODY(PERF_TRUNCATED_RSHIFT8)
+};
+
+static void narrowingTestRShift8(uint8_t index, uint32_t &checkSum) {
+    PERF_TEST_FUN_BODY(PERF_NARROWING_RSHIFT8)
+};
+
+// Widening shifts, against shifting after widening
+#define PERF_WIDENED_LSHIFT16(index, distance) if ((index)==(distance)) { checkSum += lshift<distance>((uint32_t)(uint16_t)checkSum); }
+#define PERF_WIDENING_LSHIFT16(index, distance) if ((index)==(distance)) { checkSum += lshift<distance, uint32_t>((uint16_t)checkSum); }
+
+static void widenedTestLShift16(uint8_t index, uint32_t &checkSum) { 
+    PERF_TEST_FUN_BODY(PERF_WIDENED_LSHIFT16)
+};
+
+static void wideningTestLShift16(uint8_t index, uint32_t &checkSum) {
+    PERF_TEST_FUN_BODY(PERF_WIDENING_LSHIFT16)
+};
+
+// Fixed point multiply, with the multiplier taken from the seed
+#define PERF_NATIVE_MUL_SHR(index, distance) if ((index)==(distance)) { checkSum += ((uint32_t)(uint16_t)checkSum * (uint16_t)seedValue) >> (distance); }
+#define PERF_OPTIMIZED_MUL_SHR(index, distance) if ((index)==(distance)) { checkSum += mul_shr<(distance)>((uint16_t)checkSum, (uint16_t)seedValue); }
+#define PERF_NATIVE_MUL32_SHR(index, distance) if ((index)==(distance)) { checkSum += (uint32_t)(((uint64_t)checkSum * (uint16_t)seedValue) >> (distance)); }
+#define PERF_OPTIMIZED_MUL32_SHR(index, distance) if ((index)==(distance)) { checkSum += mul_shr<(distance)>(checkSum, (uint16_t)seedValue); }
+
+static void nativeTestMulShr(uint8_t index, uint32_t &checkSum) { 
+    PERF_TEST_FUN_BODY(PERF_NATIVE_MUL_SHR)
+};
+
+static void optimizedTestMulShr(uint8_t index, uint32_t &checkSum) {
+    PERF_TEST_FUN_BODY(PERF_OPTIMIZED_MUL_SHR)
+};
+
+static void nativeTestMul32Shr(uint8_t index, uint32_t &checkSum) { 
+    PERF_TEST_FUN_BODY(PERF_NATIVE_MUL32_SHR)
+};
+
+static void optimizedTestMul32Shr(uint8_t index, uint32_t &checkSum) {
+    PERF_TEST_FUN_BODY(PERF_OPTIMIZED_MUL32_SHR)
+};
+
+// Fixed point multiply, against the hand written Q format expression
+#define PERF_NATIVE_FIXED_MUL(index, distance) if ((index)==(distance)) { checkSum += (uint32_t)(((uint64_t)checkSum * seedValue) >> (distance)); }
+#define PERF_OPTIMIZED_FIXED_MUL(index, distance) if ((index)==(distance)) { \
+        typedef ufixed<(uint8_t)(32U-(distance)), (distance)> fixed_t; \
+        checkSum += (fixed_t::from_raw(checkSum) * fixed_t::from_raw(seedValue)).raw(); }
+
+static void nativeTestFixedMul(uint8_t index, uint32_t &checkSum) { 
+    PERF_TEST_FUN_BODY(PERF_NATIVE_FIXED_MUL)
+};
+
+static void optimizedTestFixedMul(uint8_t index, uint32_t &checkSum) {
+    PERF_TEST_FUN_BODY(PERF_OPTIMIZED_FIXED_MUL)
+};
+
+// Rounding & signed division, against the C expressions. sdiv_pow2 is limited to 2^30,
+// since the native divisor can't be 2^31.
+#define PERF_NATIVE_RSHIFT_ROUND(index, distance) if ((index)==(distance)) { checkSum += (checkSum + (UINT32_C(1) << ((distance)-1U))) >> (distance); }
+#define PERF_OPTIMIZED_RSHIFT_ROUND(index, distance) if ((index)==(distance)) { checkSum += rshift_round<(distance)>(checkSum); }
+#define PERF_NATIVE_SDIV_POW2(index, distance) if ((index)==(distance)) { checkSum += (uint32_t)((int32_t)checkSum / (INT32_C(1) << ((distance)>30U ? 30U : (distance)))); }
+#define PERF_OPTIMIZED_SDIV_POW2(index, distance) if ((index)==(distance)) { checkSum += (uint32_t)sdiv_pow2<((distance)>30U ? 30U : (distance))>((int32_t)checkSum); }
+
+static void nativeTestRShiftRound(uint8_t index, uint32_t &checkSum) { 
+    PERF_TEST_FUN_BODY(PERF_NATIVE_RSHIFT_ROUND)
+};
+
+static void optimizedTestRShiftRound(uint8_t index, uint32_t &checkSum) {
+    PERF_TEST_FUN_BODY(PERF_OPTIMIZED_RSHIFT_ROUND)
+};
+
+static void nativeTestSDivPow2(uint8_t index, uint32_t &checkSum) { 
+    PERF_TEST_FUN_BODY(PERF_NATIVE_SDIV_POW2)
+};
+
+static void optimizedTestSDivPow2(uint8_t index, uint32_t &checkSum) {
+    PERF_TEST_FUN_BODY(PERF_OPTIMIZED_SDIV_POW2)
+};
+
+// Saturating shift, against checking the limit first
+#define PERF_NATIVE_LSHIFT_SAT(index, distance) if ((index)==(distance)) { checkSum += (checkSum>(UINT32_MAX >> (distance))) ? UINT32_MAX : checkSum << (distance); }
+#define PERF_OPTIMIZED_LSHIFT_SAT(index, distance) if ((index)==(distance)) { checkSum += lshift_sat<(distance)>(checkSum); }
+
+static void nativeTestLShiftSat(uint8_t index, uint32_t &checkSum) { 
+    PERF_TEST_FUN_BODY(PERF_NATIVE_LSHIFT_SAT)
+};
+
+static void optimizedTestLShiftSat(uint8_t index, uint32_t &checkSum) {
+    PERF_TEST_FUN_BODY(PERF_OPTIMIZED_LSHIFT_SAT)
+};
+
+// 96-bit shifts, against shifting limb by limb with the native operators
+#define PERF_NATIVE_LSHIFT_ARRAY(index, distance) if ((index)==(distance)) { \
+        uint32_t limbs[] = { checkSum, seedValue, checkSum ^ seedValue }; \
+        limbs[2] = (limbs[2] << (distance)) | (limbs[1] >> (32U-(distance))); \
+        limbs[1] = (limbs[1] << (distance)) | (limbs[0] >> (32U-(distance))); \
+        limbs[0] = limbs[0] << (distance); \
+        checkSum += limbs[0] + limbs[1] + limbs[2]; }
+#define PERF_OPTIMIZED_LSHIFT_ARRAY(index, distance) if ((index)==(distance)) { \
+        uint32_t limbs[] = { checkSum, seedValue, checkSum ^ seedValue }; \
+        lshift_array<(distance)>(limbs, 3U); \
+        checkSum += limbs[0] + limbs[1] + limbs[2]; }
+#define PERF_NATIVE_RSHIFT_ARRAY(index, distance) if ((index)==(distance)) { \
+        uint32_t limbs[] = { checkSum, seedValue, checkSum ^ seedValue }; \
+        limbs[0] = (limbs[0] >> (distance)) | (limbs[1] << (32U-(distance))); \
+        limbs[1] = (limbs[1] >> (distance)) | (limbs[2] << (32U-(distance))); \
+        limbs[2] = limbs[2] >> (distance); \
+        checkSum += limbs[0] + limbs[1] + limbs[2]; }
+#define PERF_OPTIMIZED_RSHIFT_ARRAY(index, distance) if ((index)==(distance)) { \
+        uint32_t limbs[] = { checkSum, seedValue, checkSum ^ seedValue }; \
+        rshift_array<(distance)>(limbs, 3U); \
+        checkSum += limbs[0] + limbs[1] + limbs[2]; }
+
+// Leading & trailing zeros, plus normalizing, against the builtins. The distance 
+// varies the number of zeros.
+#define PERF_NATIVE_CLZ(index, distance) if ((index)==(distance)) { checkSum += (uint32_t)__builtin_clzl((checkSum >> (distance)) | 1U); }
+#define PERF_OPTIMIZED_CLZ(index, distance) if ((index)==(distance)) { checkSum += clz32((checkSum >> (distance)) | 1U); }
+#define PERF_NATIVE_CTZ(index, distance) if ((index)==(distance)) { checkSum += (uint32_t)__builtin_ctzl((checkSum << (distance)) | UINT32_C(0x80000000)); }
+#define PERF_OPTIMIZED_CTZ(index, distance) if ((index)==(distance)) { checkSum += ctz32((checkSum << (distance)) | UINT32_C(0x80000000)); }
+#define PERF_NATIVE_NORMALIZE(index, distance) if ((index)==(distance)) { \
+        uint32_t value = (checkSum >> (distance)) | 1U; \
+        uint8_t exponent = (uint8_t)__builtin_clzl(value); \
+        checkSum += (value << exponent) + exponent; }
+#define PERF_OPTIMIZED_NORMALIZE(index, distance) if ((index)==(distance)) { \
+        normalized_t normalized = normalize((checkSum >> (distance)) | 1U); \
+        checkSum += normalized.value + normalized.exponent; }
+
+static void nativeTestClz(uint8_t index, uint32_t &checkSum) { 
+    PERF_TEST_FUN_BODY(PERF_NATIVE_CLZ)
+};
+
+static void optimizedTestClz(uint8_t index, uint32_t &checkSum) {
+    PERF_TEST_FUN_BODY(PERF_OPTIMIZED_CLZ)
+};
+
+static void nativeTestCtz(uint8_t index, uint32_t &checkSum) { 
+    PERF_TEST_FUN_BODY(PERF_NATIVE_CTZ)
+};
+
+static void optimizedTestCtz(uint8_t index, uint32_t &checkSum) {
+    PERF_TEST_FUN_BODY(PERF_OPTIMIZED_CTZ)
+};
+
+static void nativeTestNormalize(uint8_t index, uint32_t &checkSum) { 
+    PERF_TEST_FUN_BODY(PERF_NATIVE_NORMALIZE)
+};
+
+static void optimizedTestNormalize(uint8_t index, uint32_t &checkSum) {
+    PERF_TEST_FUN_BODY(PERF_OPTIMIZED_NORMALIZE)
+};
+
+static void nativeTestLShiftArray(uint8_t index, uint32_t &checkSum) { 
+    PERF_TEST_FUN_BODY(PERF_NATIVE_LSHIFT_ARRAY)
+};
+
+static void optimizedTestLShiftArray(uint8_t index, uint32_t &checkSum) {
+    PERF_TEST_FUN_BODY(PERF_OPTIMIZED_LSHIFT_ARRAY)
+};
+
+static void nativeTestRShiftArray(uint8_t index, uint32_t &checkSum) { 
+    PERF_TEST_FUN_BODY(PERF_NATIVE_RSHIFT_ARRAY)
+};
+
+static void optimizedTestRShiftArray(uint8_t index, uint32_t &checkSum) {
+    PERF_TEST_FUN_BODY(PERF_OPTIMIZED_RSHIFT_ARRAY)
+};
+
+static void nativeTestRotl(uint8_t index, uint32_t &checkSum) { 
+    PERF_TEST_FUN_BODY(PERF_NATIVE_ROTL)
+};
+
+static void optimizedTestRotl(uint8_t index, uint32_t &checkSum) {
+    PERF_TEST_FUN_BODY(PERF_OPTIMIZED_ROTL)
+};
+
+static void nativeTestRotl16(uint8_t index, uint16_t &checkSum) { 
+    PERF_TEST16_FUN_BODY(PERF_NATIVE_ROTL16)
+};
+
+static void optimizedTestRotl16(uint8_t index, uint16_t &checkSum) {
+    PERF_TEST16_FUN_BODY(PERF_OPTIMIZED_ROTL16)
+};
+
+#if defined(__UINT24_MAX__)
+
+#define PERF_TEST24_FUN_BODY(shift_op) \
+    if (index==0U) { \
+        if (checkSum==0U) { checkSum = (__uint24)seedValue; randomSeed(seedValue); } \
+        shiftDistance = (uint8_t)random(3, 24); \
+    } else { \
+        shift_op(shiftDistance, 3U) shift_op(shiftDistance, 4U) shift_op(shiftDistance, 5U) \
+        shift_op(shiftDistance, 6U) shift_op(shiftDistance, 7U) shift_op(shiftDistance, 9U) \
+        shift_op(shiftDistance, 10U) shift_op(shiftDistance, 11U) shift_op(shiftDistance, 12U) \
+        shift_op(shiftDistance, 13U) shift_op(shiftDistance, 14U) shift_op(shiftDistance, 15U) \
+        shift_op(shiftDistance, 17U) shift_op(shiftDistance, 18U) shift_op(shiftDistance, 19U) \
+        shift_op(shiftDistance, 20U) shift_op(shiftDistance, 21U) shift_op(shiftDistance, 22U) \
+        shift_op(shiftDistance, 23U) \
+    }
+
+// Shift via the 32-bit templates, as was necessary before the 24-bit overloads existed.
+#define PERF_WIDE_RSHIFT24(index, distance) if ((index)==(distance)) { checkSum += (__uint24)rshift<distance>((uint32_t)checkSum); }
+#define PERF_WIDE_LSHIFT24(index, distance) if ((index)==(distance)) { checkSum += (__uint24)lshift<distance>((uint32_t)checkSum); }
+
+#define PERF_NATIVE_SRSHIFT24(index, distance) if ((index)==(distance)) { checkSum += (__uint24)((__int24)checkSum >> (distance)); }
+#define PERF_OPTIMIZED_SRSHIFT24(index, distance) if ((index)==(distance)) { checkSum += (__uint24)rshift<distance>((__int24)checkSum); }
+#define PERF_WIDE_SRSHIFT24(index, distance) if ((index)==(distance)) { checkSum += (__uint24)rshift<distance>((int32_t)(__int24)checkSum); }
+
+static void nativeTestRShift24(uint8_t index, __uint24 &checkSum) { 
+    PERF_TEST24_FUN_BODY(PERF_NATIVE_RSHIFT)
+};
+
+static void optimizedTestRShift24(uint8_t index, __uint24 &checkSum) {
+    PERF_TEST24_FUN_BODY(PERF_OPTIMIZED_RSHIFT)
+};
+
+static void wideTestRShift24(uint8_t index, __uint24 &checkSum) {
+    PERF_TEST24_FUN_BODY(PERF_WIDE_RSHIFT24)
+};
+
+static void nativeTestSRShift24(uint8_t index, __uint24 &checkSum) { 
+    PERF_TEST24_FUN_BODY(PERF_NATIVE_SRSHIFT24)
+};
+
+static void optimizedTestSRShift24(uint8_t index, __uint24 &checkSum) {
+    PERF_TEST24_FUN_BODY(PERF_OPTIMIZED_SRSHIFT24)
+};
+
+static void wideTestSRShift24(uint8_t index, __uint24 &checkSum) {
+    PERF_TEST24_FUN_BODY(PERF_WIDE_SRSHIFT24)
+};
+
+static void nativeTestLShift24(uint8_t index, __uint24 &checkSum) { 
+    PERF_TEST24_FUN_BODY(PERF_NATIVE_LSHIFT)
+};
+
+static void optimizedTestLShift24(uint8_t index, __uint24 &checkSum) {
+    PERF_TEST24_FUN_BODY(PERF_OPTIMIZED_LSHIFT)
+};
+
+static void wideTestLShift24(uint8_t index, __uint24 &checkSum) {
+    PERF_TEST24_FUN_BODY(PERF_WIDE_LSHIFT24)
+};
+
+#endif
+
+#define PERF_NATIVE_SRSHIFT(index, distance) if ((index)==(distance)) { checkSum += (uint32_t)((int32_t)checkSum >> (distance)); }
+#define PERF_OPTIMIZED_SRSHIFT(index, distance) if ((index)==(distance)) { checkSum += (uint32_t)rshift<distance>((int32_t)checkSum); }
+
+static void nativeTestSRShift(uint8_t index, uint32_t &checkSum) { 
+    PERF_TEST_FUN_BODY(PERF_NATIVE_SRSHIFT)
+};
+
+static void optimizedTestSRShift(uint8_t index, uint32_t &checkSum) {
+    PERF_TEST_FUN_BODY(PERF_OPTIMIZED_SRSHIFT)
+};
+
+// Shifts in isolation flatter the optimized versions: the surrounding code has the
+// whole register file to itself. Here six 32-bit values (24 registers) are live
+// across every shift, so any registers a shift pins down cost spills & moves.
+#define PERF_PRESSURE_FUN_BODY(rshift_op, lshift_op) \
+    uint32_t v0 = checkSum + index; \
+    uint32_t v1 = v0 ^ seedValue; \
+    uint32_t v2 = v1 + seedValue; \
+    uint32_t v3 = v2 ^ (v0 + 1U); \
+    uint32_t v4 = v3 + v1; \
+    uint32_t v5 = v4 ^ v2; \
+    v0 += rshift_op(v5, 6U); \
+    v1 += lshift_op(v0, 7U); \
+    v2 += rshift_op(v1, 14U); \
+    v3 += lshift_op(v2, 15U); \
+    v4 += rshift_op(v3, 7U); \
+    v5 += lshift_op(v4, 6U); \
+    v0 += rshift_op(v5, 15U); \
+    v1 += lshift_op(v0, 14U); \
+    checkSum = v0 ^ v1 ^ v2 ^ v3 ^ v4 ^ v5;
+
+#define PERF_PRESSURE_NATIVE_RSHIFT(value, distance) ((value) >> (distance))
+#define PERF_PRESSURE_NATIVE_LSHIFT(value, distance) ((value) << (distance))
+#define PERF_PRESSURE_OPTIMIZED_RSHIFT(value, distance) rshift<(distance)>(value)
+#define PERF_PRESSURE_OPTIMIZED_LSHIFT(value, distance) lshift<(distance)>(value)
+
+static void nativeTestPressureShift(uint8_t index, uint32_t &checkSum) { 
+    PERF_PRESSURE_FUN_BODY(PERF_PRESSURE_NATIVE_RSHIFT, PERF_PRESSURE_NATIVE_LSHIFT)
+};
+
+static void optimizedTestPressureShift(uint8_t index, uint32_t &checkSum) {
+    PERF_PRESSURE_FUN_BODY(PERF_PRESSURE_OPTIMIZED_RSHIFT, PERF_PRESSURE_OPTIMIZED_LSHIFT)
+};
+
+#endif 
+
+static void test_rshift_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    seedValue = rand();
+
+    auto comparison = compare_executiontime<uint8_t, uint32_t>(iters, start_index, end_index, step, nativeTestRShift, optimizedTestRShift);
+    
+    MESSAGE_TIMERS(comparison.timeA.timer, comparison.timeB.timer);
+    TEST_ASSERT_EQUAL(comparison.timeA.result, comparison.timeB.result);
+
+    TEST_ASSERT_LESS_THAN(comparison.timeA.timer.duration_micros(), comparison.timeB.timer.duration_micros());
+#endif
+}
+
+
+static void test_signed_rshift_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    seedValue = rand();
+
+    auto comparison = compare_executiontime<uint8_t, uint32_t>(iters, start_index, end_index, step, nativeTestSRShift, optimizedTestSRShift);
+    
+    MESSAGE_TIMERS(comparison.timeA.timer, comparison.timeB.timer);
+    TEST_ASSERT_EQUAL(comparison.timeA.result, comparison.timeB.result);
+
+    TEST_ASSERT_LESS_THAN(comparison.timeA.timer.duration_micros(), comparison.timeB.timer.duration_micros());
+#endif
+}
+
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+template <typename TParam>
+static void compare_perf(void (*pBaseline)(uint8_t, TParam&), void (*pOptimized)(uint8_t, TParam&)) {
+    seedValue = rand();
+
+    auto comparison = compare_executiontime<uint8_t, TParam>(iters, start_index, end_index, step, pBaseline, pOptimized);
+    
+    MESSAGE_TIMERS(comparison.timeA.timer, comparison.timeB.timer);
+    // Unity truncates integers to 32-bits, so compare in full here.
+    TEST_ASSERT_TRUE(comparison.timeA.result==comparison.timeB.result);
+
+    TEST_ASSERT_LESS_THAN(comparison.timeA.timer.duration_micros(), comparison.timeB.timer.duration_micros());
+}
+#endif
+
+static void test_register_pressure_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    compare_perf<uint32_t>(nativeTestPressureShift, optimizedTestPressureShift);
+#endif
+}
+
+static void test_rshift64_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    compare_perf<uint64_t>(nativeTestRShift64, optimizedTestRShift64);
+#endif
+}
+
+static void test_signed_rshift64_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    compare_perf<uint64_t>(nativeTestSRShift64, optimizedTestSRShift64);
+#endif
+}
+
+static void test_lshift64_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    compare_perf<uint64_t>(nativeTestLShift64, optimizedTestLShift64);
+#endif
+}
+
+static void test_rshift16_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    compare_perf<uint16_t>(nativeTestRShift16, optimizedTestRShift16);
+#endif
+}
+
+static void test_signed_rshift16_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    compare_perf<uint16_t>(nativeTestSRShift16, optimizedTestSRShift16);
+#endif
+}
+
+static void test_lshift16_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    compare_perf<uint16_t>(nativeTestLShift16, optimizedTestLShift16);
+#endif
+}
+
+static void test_rotl_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    compare_perf<uint32_t>(nativeTestRotl, optimizedTestRotl);
+#endif
+}
+
+static void test_rotl16_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    compare_perf<uint16_t>(nativeTestRotl16, optimizedTestRotl16);
+#endif
+}
+
+static void test_extract_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    compare_perf<uint32_t>(nativeTestExtract, optimizedTestExtract);
+#endif
+}
+
+static void test_narrowing_rshift_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    compare_perf<uint32_t>(truncatedTestRShift16, narrowingTestRShift16);
+    compare_perf<uint32_t>(truncatedTestRShift8, narrowingTestRShift8);
+#endif
+}
+
+static void test_widening_lshift_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    compare_perf<uint32_t>(widenedTestLShift16, wideningTestLShift16);
+#endif
+}
+
+static void test_mul_shr_perf(void) {
+// Without MUL the multiply is C either way
+#if defined(AFS_USE_OPTIMIZED_SHIFTS) && defined(__AVR_HAVE_MUL__)
+    compare_perf<uint32_t>(nativeTestMulShr, optimizedTestMulShr);
+    compare_perf<uint32_t>(nativeTestMul32Shr, optimizedTestMul32Shr);
+#endif
+}
+
+static void test_fixed_mul_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    compare_perf<uint32_t>(nativeTestFixedMul, optimizedTestFixedMul);
+#endif
+}
+
+static void test_rshift_round_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    compare_perf<uint32_t>(nativeTestRShiftRound, optimizedTestRShiftRound);
+    compare_perf<uint32_t>(nativeTestSDivPow2, optimizedTestSDivPow2);
+#endif
+}
+
+static void test_lshift_sat_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    compare_perf<uint32_t>(nativeTestLShiftSat, optimizedTestLShiftSat);
+#endif
+}
+
+static void test_shift_array_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    compare_perf<uint32_t>(nativeTestLShiftArray, optimizedTestLShiftArray);
+    compare_perf<uint32_t>(nativeTestRShiftArray, optimizedTestRShiftArray);
+#endif
+}
+
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+// Buffer throughput: the native operator, rshift<b> in a loop & rshift_n<b>
+static constexpr uint16_t throughput_count = 64U;
+static uint32_t throughput_buffer[throughput_count];
+
+template <uint8_t b>
+struct throughput_rshift_t {
+    static void __attribute__((noinline)) native(uint32_t *buf, size_t n) {
+        for (size_t index=0; index<n; ++index) { buf[index] = buf[index] >> b; }
+    }
+    static void __attribute__((noinline)) looped(uint32_t *buf, size_t n) {
+        for (size_t index=0; index<n; ++index) { buf[index] = rshift<b>(buf[index]); }
+    }
+    static void __attribute__((noinline)) bulk(uint32_t *buf, size_t n) { rshift_n<b>(buf, n); }
+};
+
+template <uint8_t b>
+struct throughput_lshift_t {
+    static void __attribute__((noinline)) native(uint32_t *buf, size_t n) {
+        for (size_t index=0; index<n; ++index) { buf[index] = buf[index] << b; }
+    }
+    static void __attribute__((noinline)) looped(uint32_t *buf, size_t n) {
+        for (size_t index=0; index<n; ++index) { buf[index] = lshift<b>(buf[index]); }
+    }
+    static void __attribute__((noinline)) bulk(uint32_t *buf, size_t n) { lshift_n<b>(buf, n); }
+};
+
+template <void (*pShift)(uint32_t *, size_t)>
+static uint16_t measure_throughput(void) {
+    for (uint16_t index=0; index<throughput_count; ++index) {
+        throughput_buffer[index] = seedValue + index;
+    }
+    cycle_timer_t timer;
+    timer.start();
+    pShift(throughput_buffer, throughput_count);
+    timer.stop();
+    return timer.cycles();
+}
+
+template <template <uint8_t> class TShift, uint8_t b>
+static void report_throughput(const char *label) {
+    const uint16_t bytes = (uint16_t)sizeof(throughput_buffer);
+    const uint16_t nativeCycles = measure_throughput<&TShift<b>::native>();
+    const uint16_t loopedCycles = measure_throughput<&TShift<b>::looped>();
+    const uint16_t bulkCycles = measure_throughput<&TShift<b>::bulk>();
+    char szLabel[64];
+    snprintf(szLabel, sizeof(szLabel), "%s<%u> native", label, b);
+    MESSAGE_THROUGHPUT(szLabel, nativeCycles, bytes);
+    snprintf(szLabel, sizeof(szLabel), "%s<%u> loop", label, b);
+    MESSAGE_THROUGHPUT(szLabel, loopedCycles, bytes);
+    snprintf(szLabel, sizeof(szLabel), "%s_n<%u>", label, b);
+    MESSAGE_THROUGHPUT(szLabel, bulkCycles, bytes);
+    TEST_ASSERT_LESS_THAN(nativeCycles, bulkCycles);
+#if defined(__OPTIMIZE__)
+    // At -O0 the bulk kernel's steps are calls
+    TEST_ASSERT_LESS_THAN(loopedCycles, bulkCycles);
+#endif
+}
+#endif
+
+static void test_shift_n_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    report_throughput<throughput_rshift_t, 1U>("rshift");
+    report_throughput<throughput_rshift_t, 7U>("rshift");
+    report_throughput<throughput_rshift_t, 12U>("rshift");
+    report_throughput<throughput_rshift_t, 21U>("rshift");
+    report_throughput<throughput_lshift_t, 1U>("lshift");
+    report_throughput<throughput_lshift_t, 7U>("lshift");
+    report_throughput<throughput_lshift_t, 12U>("lshift");
+    report_throughput<throughput_lshift_t, 21U>("lshift");
+#endif
+}
+
+static void test_clz_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    compare_perf<uint32_t>(nativeTestClz, optimizedTestClz);
+    compare_perf<uint32_t>(nativeTestCtz, optimizedTestCtz);
+    compare_perf<uint32_t>(nativeTestNormalize, optimizedTestNormalize);
+#endif
+}
+
+static void test_rshift24_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS) && defined(__UINT24_MAX__)
+    compare_perf<__uint24>(nativeTestRShift24, optimizedTestRShift24);
+    compare_perf<__uint24>(wideTestRShift24, optimizedTestRShift24);
+#endif
+}
+
+static void test_signed_rshift24_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS) && defined(__UINT24_MAX__)
+    compare_perf<__uint24>(nativeTestSRShift24, optimizedTestSRShift24);
+    compare_perf<__uint24>(wideTestSRShift24, optimizedTestSRShift24);
+#endif
+}
+
+static void test_lshift24_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS) && defined(__UINT24_MAX__)
+    compare_perf<__uint24>(nativeTestLShift24, optimizedTestLShift24);
+    compare_perf<__uint24>(wideTestLShift24, optimizedTestLShift24);
+#endif
+}
+
+static void test_lshift_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    seedValue = rand();
+
+    auto comparison = compare_executiontime<uint8_t, uint32_t>(iters, start_index, end_index, step, nativeTestLShift, optimizedTestLShift);
+    
+    MESSAGE_TIMERS(comparison.timeA.timer, comparison.timeB.timer);
+    TEST_ASSERT_EQUAL(comparison.timeA.result, comparison.timeB.result);
+
+    TEST_ASSERT_LESS_THAN(comparison.timeA.timer.duration_micros(), comparison.timeB.timer.duration_micros());
+#endif
+}
+
+// The macros below are used to ensure the performance test functions
+// have the same number of operations
+//
+// So we are comparing apples-to-apples
+
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+
+#define PERF_RT_NATIVE_RSHIFT(checkSum, shiftDistance) (checkSum) += (checkSum) >> (shiftDistance);
+#define PERF_RT_NATIVE_LSHIFT(checkSum, shiftDistance) (checkSum) += (checkSum) << (shiftDistance);
+
+#define PERF_RT_OPTIMIZED_RSHIFT(checkSum, shiftDistance) (checkSum) += rshift((checkSum), (shiftDistance));
+#define PERF_RT_OPTIMIZED_LSHIFT(checkSum, shiftDistance) (checkSum) += lshift((checkSum), (shiftDistance));
+
+// Randomness here is all about ensuring that the compiler doesn't optimize away the shifts
+// (which it won't do in normal operaton when the shift operands are unknown at compile time.)
+#define PERF_RT_TEST_FUN_BODY(shift_op) \
+    if (index==0U) { \
+        if (checkSum==0U) { checkSum = seedValue; randomSeed(seedValue); } \
+        shiftDistance = (uint8_t)random(1, 32); \
+    } else { \
+        shift_op(checkSum, shiftDistance); \
+    }
+
+static inline void rtNativeTestRShift(uint8_t index, uint32_t &checkSum) { 
+    PERF_RT_TEST_FUN_BODY(PERF_RT_NATIVE_RSHIFT)
+};
+
+static inline void rtOptimizedTestRShift(uint8_t index, uint32_t &checkSum) {
+    PERF_RT_TEST_FUN_BODY(PERF_RT_OPTIMIZED_RSHIFT)
+};
+
+static inline void rtNativeTestLShift(uint8_t index, uint32_t &checkSum) { 
+    PERF_RT_TEST_FUN_BODY(PERF_RT_NATIVE_LSHIFT)
+};
+
+static inline void rtOptimizedTestLShift(uint8_t index, uint32_t &checkSum) {
+    PERF_RT_TEST_FUN_BODY(PERF_RT_OPTIMIZED_LSHIFT)
+};
+
+// As above, but with the distance held at shiftDistance so each distance can be
+// timed on its own.
+#define PERF_RT_FIXED_TEST_FUN_BODY(shift_op) \
+    if (checkSum==0U) { checkSum = seedValue + index; } \
+    shift_op(checkSum, shiftDistance);
+
+static inline void rtNativeFixedTestRShift(uint8_t index, uint32_t &checkSum) { 
+    PERF_RT_FIXED_TEST_FUN_BODY(PERF_RT_NATIVE_RSHIFT)
+};
+
+static inline void rtOptimizedFixedTestRShift(uint8_t index, uint32_t &checkSum) {
+    PERF_RT_FIXED_TEST_FUN_BODY(PERF_RT_OPTIMIZED_RSHIFT)
+};
+
+static inline void rtNativeFixedTestLShift(uint8_t index, uint32_t &checkSum) { 
+    PERF_RT_FIXED_TEST_FUN_BODY(PERF_RT_NATIVE_LSHIFT)
+};
+
+static inline void rtOptimizedFixedTestLShift(uint8_t index, uint32_t &checkSum) {
+    PERF_RT_FIXED_TEST_FUN_BODY(PERF_RT_OPTIMIZED_LSHIFT)
+};
+
+#define PERF_RT_SWITCH_RSHIFT(checkSum, shiftDistance) (checkSum) += afs_detail::rshift_switch((checkSum), (shiftDistance));
+#define PERF_RT_SWITCH_LSHIFT(checkSum, shiftDistance) (checkSum) += afs_detail::lshift_switch((checkSum), (shiftDistance));
+
+static inline void rtSwitchFixedTestRShift(uint8_t index, uint32_t &checkSum) { 
+    PERF_RT_FIXED_TEST_FUN_BODY(PERF_RT_SWITCH_RSHIFT)
+};
+
+static inline void rtSwitchFixedTestLShift(uint8_t index, uint32_t &checkSum) { 
+    PERF_RT_FIXED_TEST_FUN_BODY(PERF_RT_SWITCH_LSHIFT)
+};
+
+#if defined(__AVR_HAVE_MUL__)
+
+#define PERF_RT_MUL_RSHIFT(checkSum, shiftDistance) (checkSum) += afs_detail::rshift_mul((checkSum), (shiftDistance));
+#define PERF_RT_MUL_LSHIFT(checkSum, shiftDistance) (checkSum) += afs_detail::lshift_mul((checkSum), (shiftDistance));
+
+static inline void rtMulFixedTestRShift(uint8_t index, uint32_t &checkSum) {
+    PERF_RT_FIXED_TEST_FUN_BODY(PERF_RT_MUL_RSHIFT)
+};
+
+static inline void rtMulFixedTestLShift(uint8_t index, uint32_t &checkSum) {
+    PERF_RT_FIXED_TEST_FUN_BODY(PERF_RT_MUL_LSHIFT)
+};
+
+#endif
+
+#if (defined(AFS_RUNTIME_MUL_SHIFT) && defined(__AVR_HAVE_MUL__)) || defined(AFS_RUNTIME_CONSTANT_TIME)
+constexpr bool runtime_fixed_cost = true;
+#else
+constexpr bool runtime_fixed_cost = false;
+#endif
+
+constexpr uint16_t per_distance_iters = 64;
+
+struct distance_timing_t {
+    uint32_t best;
+    uint32_t worst;
+    uint32_t total;
+
+    void add(uint32_t duration) {
+        best = duration<best ? duration : best;
+        worst = duration>worst ? duration : worst;
+        total += duration;
+    }
+};
+
+// Time every shift distance separately, report the worst case & average
+// and check the optimized worst case beats the baseline one.
+static void compare_runtime_distances(void (*pBaseline)(uint8_t, uint32_t&), void (*pOptimized)(uint8_t, uint32_t&), bool fixedCost) {
+    distance_timing_t baseline = { UINT32_MAX, 0U, 0U };
+    distance_timing_t optimized = { UINT32_MAX, 0U, 0U };
+    constexpr uint8_t num_distances = 32U;
+
+    for (uint8_t distance=0U; distance<num_distances; ++distance) {
+        shiftDistance = distance;
+        auto comparison = compare_executiontime<uint8_t, uint32_t>(per_distance_iters, start_index, end_index, step, pBaseline, pOptimized);
+        TEST_ASSERT_EQUAL(comparison.timeA.result, comparison.timeB.result);
+        baseline.add(comparison.timeA.timer.duration_micros());
+        optimized.add(comparison.timeB.timer.duration_micros());
+    }
+
+    TEST_PRINTF("Worst case: %lu, %lu; Average: %lu, %lu", 
+                baseline.worst, optimized.worst, baseline.total/num_distances, optimized.total/num_distances);
+    TEST_ASSERT_LESS_THAN(baseline.worst, optimized.worst);
+    if (fixedCost) {
+        // Allow a little for timer jitter
+        TEST_ASSERT_UINT32_WITHIN(optimized.best/20U, optimized.best, optimized.worst);
+    }
+}
+
+#if defined(__UINT24_MAX__) && defined(AFS_RUNTIME_API)
+
+#define PERF_RT24_TEST_FUN_BODY(shift_op) \
+    if (index==0U) { \
+        if (checkSum==0U) { checkSum = (__uint24)seedValue; randomSeed(seedValue); } \
+        shiftDistance = (uint8_t)random(1, 24); \
+    } else { \
+        shift_op(checkSum, shiftDistance); \
+    }
+
+static inline void rtNativeTestRShift24(uint8_t index, __uint24 &checkSum) { 
+    PERF_RT24_TEST_FUN_BODY(PERF_RT_NATIVE_RSHIFT)
+};
+
+static inline void rtOptimizedTestRShift24(uint8_t index, __uint24 &checkSum) {
+    PERF_RT24_TEST_FUN_BODY(PERF_RT_OPTIMIZED_RSHIFT)
+};
+
+static inline void rtNativeTestLShift24(uint8_t index, __uint24 &checkSum) { 
+    PERF_RT24_TEST_FUN_BODY(PERF_RT_NATIVE_LSHIFT)
+};
+
+static inline void rtOptimizedTestLShift24(uint8_t index, __uint24 &checkSum) {
+    PERF_RT24_TEST_FUN_BODY(PERF_RT_OPTIMIZED_LSHIFT)
+};
+
+#endif
+
+#endif
+
+static void test_runtime_rshift_perf(void) {
 #if defined(AFS_USE_OPTIMIZED_SHIFTS) && defined(AFS_RUNTIME_API)
     seedValue = rand();
 
@@ -313,6 +1841,8 @@ static void test_runtime_rshift_perf(void) {
     TEST_ASSERT_EQUAL(comparison.timeA.result, comparison.timeB.result);
 
     TEST_ASSERT_LESS_THAN(comparison.timeA.timer.duration_micros(), comparison.timeB.timer.duration_micros());
+
+    compare_runtime_distances(rtNativeFixedTestRShift, rtOptimizedFixedTestRShift, runtime_fixed_cost);
 #endif
 }
 
@@ -326,6 +1856,387 @@ static void test_runtime_lshift_perf(void) {
     TEST_ASSERT_EQUAL(comparison.timeA.result, comparison.timeB.result);
 
     TEST_ASSERT_LESS_THAN(comparison.timeA.timer.duration_micros(), comparison.timeB.timer.duration_micros());
+
+    compare_runtime_distances(rtNativeFixedTestLShift, rtOptimizedFixedTestLShift, runtime_fixed_cost);
+#endif
+}
+
+static void test_runtime_mul_shift_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS) && defined(AFS_RUNTIME_API) && defined(__AVR_HAVE_MUL__)
+    seedValue = rand();
+    compare_runtime_distances(rtSwitchFixedTestRShift, rtMulFixedTestRShift, true);
+    compare_runtime_distances(rtSwitchFixedTestLShift, rtMulFixedTestLShift, true);
+#endif
+}
+
+static void test_runtime_shift24_perf(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS) && defined(AFS_RUNTIME_API) && defined(__UINT24_MAX__)
+    compare_perf<__uint24>(rtNativeTestRShift24, rtOptimizedTestRShift24);
+    compare_perf<__uint24>(rtNativeTestLShift24, rtOptimizedTestLShift24);
+#endif
+}
+
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+
+// Exact cycle counts for each shift distance, optimized vs the native operator.
+
+template <typename T, T (*pShift)(T)>
+static uint16_t measure_cycles(T value) {
+    cycle_timer_t timer;
+    cycle_barrier(value);
+    timer.start();
+    cycle_barrier(value);
+    value = pShift(value);
+    cycle_barrier(value);
+    timer.stop();
+    return timer.cycles();
+}
+
+template <uint8_t b, typename T>
+struct lshift_cycles_t {
+    static T native(T value) { return (T)(value << b); }
+    static T optimized(T value) { return lshift<b>(value); }
+};
+
+template <uint8_t b, typename T>
+struct rshift_cycles_t {
+    static T native(T value) { return (T)(value >> b); }
+    static T optimized(T value) { return rshift<b>(value); }
+};
+
+// Shifting a uint32_t in memory: load then shift vs loading only the bytes needed
+static volatile uint32_t memory_value;
+
+template <uint8_t b, typename T>
+struct memory_lshift_cycles_t {
+    static T native(T) { return lshift<b>((T)memory_value); }
+    static T optimized(T) { return lshift<b>(&memory_value); }
+};
+
+template <uint8_t b, typename T>
+struct memory_rshift_cycles_t {
+    static T native(T) { return rshift<b>((T)memory_value); }
+    static T optimized(T) { return rshift<b>(&memory_value); }
+};
+
+// In place shift of a value shared with an ISR: ATOMIC_BLOCK around a native
+// shift vs atomic_*shift_assign. Interrupts are disabled for the whole call,
+// so these are the interrupts-off windows.
+static volatile uint32_t shared_value;
+
+template <uint8_t b, typename T>
+struct atomic_lshift_cycles_t {
+    static T native(T) { 
+        T result;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            result = (T)(shared_value << b);
+            shared_value = result;
+        }
+        return result;
+    }
+    static T optimized(T) { return atomic_lshift_assign<b>(shared_value); }
+};
+
+template <uint8_t b, typename T>
+struct atomic_rshift_cycles_t {
+    static T native(T) { 
+        T result;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            result = (T)(shared_value >> b);
+            shared_value = result;
+        }
+        return result;
+    }
+    static T optimized(T) { return atomic_rshift_assign<b>(shared_value); }
+};
+
+template <template <uint8_t, typename> class TShift, typename T, uint8_t b>
+struct cycle_suite_t {
+    static void run(T value, uint16_t *pNative, uint16_t *pOptimized) {
+        pNative[b-1U] = measure_cycles<T, &TShift<b, T>::native>(value);
+        pOptimized[b-1U] = measure_cycles<T, &TShift<b, T>::optimized>(value);
+        cycle_suite_t<TShift, T, b-1U>::run(value, pNative, pOptimized);
+    }
+};
+
+template <template <uint8_t, typename> class TShift, typename T>
+struct cycle_suite_t<TShift, T, 0U> {
+    static void run(T, uint16_t *, uint16_t *) {
+    }
+};
+
+static void message_cycles(const char *label, const uint16_t *pNative, const uint16_t *pOptimized, uint8_t count, uint8_t firstDistance) {
+    uint32_t nativeTotal = 0U;
+    uint32_t optimizedTotal = 0U;
+    for (uint8_t index=0; index<count; ++index) {
+        nativeTotal += pNative[index];
+        optimizedTotal += pOptimized[index];
+    }
+#if defined(AFS_BENCH_CSV)
+    MESSAGE_BENCH(label, "native", pNative, count, firstDistance);
+    MESSAGE_BENCH(label, "optimized", pOptimized, count, firstDistance);
+#else
+    (void)firstDistance;
+    char szLabel[64];
+    snprintf(szLabel, sizeof(szLabel), "%s native", label);
+    MESSAGE_CYCLES(szLabel, pNative, count);
+    snprintf(szLabel, sizeof(szLabel), "%s optimized", label);
+    MESSAGE_CYCLES(szLabel, pOptimized, count);
+#endif
+#if defined(__OPTIMIZE__)
+    // At -O0 the optimized shifts are calls
+    TEST_ASSERT_LESS_OR_EQUAL(nativeTotal, optimizedTotal);
+#else
+    (void)nativeTotal;
+    (void)optimizedTotal;
+#endif
+}
+
+// Report the cycles for distances 1 to maxDistance
+template <template <uint8_t, typename> class TShift, typename T, uint8_t maxDistance>
+static void report_cycles(const char *label, T value) {
+    uint16_t native[maxDistance];
+    uint16_t optimized[maxDistance];
+    cycle_suite_t<TShift, T, maxDistance>::run(value, native, optimized);
+    message_cycles(label, native, optimized, maxDistance, 1U);
+}
+
+template <typename T, T (*pShift)(T, uint8_t)>
+static uint16_t measure_runtime_cycles(T value, uint8_t distance) {
+    cycle_timer_t timer;
+    cycle_barrier(value);
+    cycle_barrier(distance);
+    timer.start();
+    cycle_barrier(value);
+    cycle_barrier(distance);
+    value = pShift(value, distance);
+    cycle_barrier(value);
+    timer.stop();
+    return timer.cycles();
+}
+
+template <typename T>
+struct runtime_cycles_t {
+    static T native_lshift(T value, uint8_t distance) { return (T)(value << distance); }
+    static T optimized_lshift(T value, uint8_t distance) { return lshift(value, distance); }
+    static T native_rshift(T value, uint8_t distance) { return (T)(value >> distance); }
+    static T optimized_rshift(T value, uint8_t distance) { return rshift(value, distance); }
+};
+
+// Report the cycles for distances 0 to numDistances-1
+template <typename T, T (*pNative)(T, uint8_t), T (*pOptimized)(T, uint8_t)>
+static void report_runtime_cycles(const char *label, T value, uint8_t numDistances) {
+    uint16_t native[32];
+    uint16_t optimized[32];
+    for (uint8_t distance=0; distance<numDistances; ++distance) {
+        native[distance] = measure_runtime_cycles<T, pNative>(value, distance);
+        optimized[distance] = measure_runtime_cycles<T, pOptimized>(value, distance);
+    }
+    message_cycles(label, native, optimized, numDistances, 0U);
+}
+
+// AFS_SIZE_OPTIMIZED: shifts inlined at every call site vs calling one shared routine.
+
+typedef uint32_t (*shift32_t)(uint32_t);
+
+static volatile uint32_t size_test_value;
+
+// 3 call sites for each shift
+template <shift32_t pShift1, shift32_t pShift2, shift32_t pShift3>
+static void __attribute__((noinline)) size_test_sites(void) {
+    size_test_value = pShift1(size_test_value);
+    size_test_value = pShift2(size_test_value);
+    size_test_value = pShift3(size_test_value);
+    size_test_value = pShift1(size_test_value);
+    size_test_value = pShift2(size_test_value);
+    size_test_value = pShift3(size_test_value);
+    size_test_value = pShift1(size_test_value);
+    size_test_value = pShift2(size_test_value);
+    size_test_value = pShift3(size_test_value);
+}
+
+// The inline kernel is reported as "native", the shared routine as "optimized"
+template <uint8_t b, typename T>
+struct shared_lshift_cycles_t {
+    static T native(T value) { return afs_detail::lshift<b>(value); }
+    static T optimized(T value) { return afs_detail::shared_shift<T, afs_detail::lshift<b>>(value); }
+};
+
+template <uint8_t b, typename T>
+struct shared_rshift_cycles_t {
+    static T native(T value) { return afs_detail::rshift<b>(value); }
+    static T optimized(T value) { return afs_detail::shared_shift<T, afs_detail::rshift<b>>(value); }
+};
+
+template <template <uint8_t, typename> class TShift>
+static void report_shared_cycles(const char *label) {
+    uint16_t inlined[31];
+    uint16_t shared[31];
+    cycle_suite_t<TShift, uint32_t, 31U>::run(UINT32_C(0xFEDCBA98), inlined, shared);
+    char szLabel[64];
+    snprintf(szLabel, sizeof(szLabel), "%s inline", label);
+    MESSAGE_CYCLES(szLabel, inlined, 31U);
+    snprintf(szLabel, sizeof(szLabel), "%s shared", label);
+    MESSAGE_CYCLES(szLabel, shared, 31U);
+}
+
+// fast_int_t vs calling the templates directly: these should be identical.
+
+template <uint8_t b, typename T>
+struct wrapper_lshift_cycles_t {
+    static T native(T value) { return lshift<b>(value); }
+    static T optimized(T value) { return fast_int_t<T>(value) << shift_constant<b>(); }
+};
+
+template <uint8_t b, typename T>
+struct wrapper_rshift_cycles_t {
+    static T native(T value) { return rshift<b>(value); }
+    static T optimized(T value) { return fast_int_t<T>(value) >> shift_constant<b>(); }
+};
+
+template <typename T>
+struct wrapper_runtime_cycles_t {
+    static T direct_lshift(T value, uint8_t distance) { return lshift(value, distance); }
+    static T wrapped_lshift(T value, uint8_t distance) { return fast_int_t<T>(value) << distance; }
+    static T direct_rshift(T value, uint8_t distance) { return rshift(value, distance); }
+    static T wrapped_rshift(T value, uint8_t distance) { return fast_int_t<T>(value) >> distance; }
+};
+
+static void message_wrapper_cycles(const char *label, const uint16_t *pDirect, const uint16_t *pWrapped, uint8_t count) {
+    char szLabel[64];
+    snprintf(szLabel, sizeof(szLabel), "%s direct", label);
+    MESSAGE_CYCLES(szLabel, pDirect, count);
+    snprintf(szLabel, sizeof(szLabel), "%s fast_int_t", label);
+    MESSAGE_CYCLES(szLabel, pWrapped, count);
+#if defined(__OPTIMIZE__)
+    // At -O0 the wrapper's operators are calls
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(pDirect, pWrapped, count);
+#endif
+}
+
+template <template <uint8_t, typename> class TShift, typename T>
+static void report_wrapper_cycles(const char *label, T value) {
+    uint16_t direct[31];
+    uint16_t wrapped[31];
+    cycle_suite_t<TShift, T, 31U>::run(value, direct, wrapped);
+    message_wrapper_cycles(label, direct, wrapped, 31U);
+}
+
+template <typename T, T (*pDirect)(T, uint8_t), T (*pWrapped)(T, uint8_t)>
+static void report_wrapper_runtime_cycles(const char *label, T value) {
+    uint16_t direct[32];
+    uint16_t wrapped[32];
+    for (uint8_t distance=0; distance<32U; ++distance) {
+        direct[distance] = measure_runtime_cycles<T, pDirect>(value, distance);
+        wrapped[distance] = measure_runtime_cycles<T, pWrapped>(value, distance);
+    }
+    message_wrapper_cycles(label, direct, wrapped, 32U);
+}
+
+#endif
+
+static void test_size_optimized(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    using afs_detail::shared_shift;
+    // Make sure the functions are linked in
+    size_test_value = UINT32_C(0xFEDCBA98);
+    size_test_sites<afs_detail::lshift<6U>, afs_detail::rshift<7U>, afs_detail::lshift<14U>>();
+    size_test_sites<shared_shift<uint32_t, afs_detail::lshift<6U>>, 
+                    shared_shift<uint32_t, afs_detail::rshift<7U>>, 
+                    shared_shift<uint32_t, afs_detail::lshift<14U>>>();
+
+    uint16_t inlineSize = function_size(&size_test_sites<afs_detail::lshift<6U>, afs_detail::rshift<7U>, afs_detail::lshift<14U>>);
+    uint16_t sharedSites = function_size(&size_test_sites<shared_shift<uint32_t, afs_detail::lshift<6U>>, 
+                                                          shared_shift<uint32_t, afs_detail::rshift<7U>>, 
+                                                          shared_shift<uint32_t, afs_detail::lshift<14U>>>);
+    uint16_t sharedRoutines = (uint16_t)(function_size(&shared_shift<uint32_t, afs_detail::lshift<6U>>) 
+                                       + function_size(&shared_shift<uint32_t, afs_detail::rshift<7U>>) 
+                                       + function_size(&shared_shift<uint32_t, afs_detail::lshift<14U>>));
+    TEST_PRINTF("Flash: inline %u bytes, shared %u bytes (call sites %u, routines %u)", 
+                inlineSize, sharedSites+sharedRoutines, sharedSites, sharedRoutines);
+#if defined(__OPTIMIZE__)
+    // Without optimization, nothing is inlined
+    TEST_ASSERT_LESS_THAN(inlineSize, sharedSites+sharedRoutines);
+#endif
+
+    report_shared_cycles<shared_lshift_cycles_t>("lshift<uint32_t>");
+    report_shared_cycles<shared_rshift_cycles_t>("rshift<uint32_t>");
+#endif
+}
+
+static void test_cycles32(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    report_cycles<lshift_cycles_t, uint32_t, 31U>("lshift<uint32_t>", UINT32_C(0xFEDCBA98));
+    report_cycles<rshift_cycles_t, uint32_t, 31U>("rshift<uint32_t>", UINT32_C(0xFEDCBA98));
+    report_cycles<rshift_cycles_t, int32_t, 31U>("rshift<int32_t>", INT32_C(-19088744));
+#endif
+}
+
+static void test_cycles16(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    report_cycles<lshift_cycles_t, uint16_t, 15U>("lshift<uint16_t>", (uint16_t)0xFEDCU);
+    report_cycles<rshift_cycles_t, uint16_t, 15U>("rshift<uint16_t>", (uint16_t)0xFEDCU);
+    report_cycles<rshift_cycles_t, int16_t, 15U>("rshift<int16_t>", (int16_t)-12345);
+#endif
+}
+
+static void test_cycles24(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS) && defined(__UINT24_MAX__)
+    report_cycles<lshift_cycles_t, __uint24, 23U>("lshift<__uint24>", (__uint24)0xFEDCBAUL);
+    report_cycles<rshift_cycles_t, __uint24, 23U>("rshift<__uint24>", (__uint24)0xFEDCBAUL);
+    report_cycles<rshift_cycles_t, __int24, 23U>("rshift<__int24>", (__int24)-1234567L);
+#endif
+}
+
+static void test_cycles64(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    report_cycles<lshift_cycles_t, uint64_t, 63U>("lshift<uint64_t>", UINT64_C(0xFEDCBA9876543210));
+    report_cycles<rshift_cycles_t, uint64_t, 63U>("rshift<uint64_t>", UINT64_C(0xFEDCBA9876543210));
+    report_cycles<rshift_cycles_t, int64_t, 63U>("rshift<int64_t>", INT64_C(-0x0123456789ABCDEF));
+#endif
+}
+
+static void test_memory_cycles(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    memory_value = UINT32_C(0xFEDCBA98);
+    report_cycles<memory_lshift_cycles_t, uint32_t, 31U>("lshift<uint32_t*>", 0U);
+    report_cycles<memory_rshift_cycles_t, uint32_t, 31U>("rshift<uint32_t*>", 0U);
+#endif
+}
+
+static void test_atomic_cycles(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    // The value doesn't change the cycle counts, so no need to reset it
+    shared_value = UINT32_C(0xFEDCBA98);
+    report_cycles<atomic_lshift_cycles_t, uint32_t, 31U>("atomic_lshift_assign", 0U);
+    report_cycles<atomic_rshift_cycles_t, uint32_t, 31U>("atomic_rshift_assign", 0U);
+#endif
+}
+
+static void test_runtime_cycles(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS) && defined(AFS_RUNTIME_API)
+    typedef runtime_cycles_t<uint32_t> rt32_t;
+    report_runtime_cycles<uint32_t, rt32_t::native_lshift, rt32_t::optimized_lshift>("lshift(uint32_t)", UINT32_C(0xFEDCBA98), 32U);
+    report_runtime_cycles<uint32_t, rt32_t::native_rshift, rt32_t::optimized_rshift>("rshift(uint32_t)", UINT32_C(0xFEDCBA98), 32U);
+#if defined(__UINT24_MAX__)
+    typedef runtime_cycles_t<__uint24> rt24_t;
+    report_runtime_cycles<__uint24, rt24_t::native_lshift, rt24_t::optimized_lshift>("lshift(__uint24)", (__uint24)0xFEDCBAUL, 24U);
+    report_runtime_cycles<__uint24, rt24_t::native_rshift, rt24_t::optimized_rshift>("rshift(__uint24)", (__uint24)0xFEDCBAUL, 24U);
+#endif
+#endif
+}
+
+static void test_wrapper_cycles(void) {
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    report_wrapper_cycles<wrapper_lshift_cycles_t, uint32_t>("lshift<uint32_t>", UINT32_C(0xFEDCBA98));
+    report_wrapper_cycles<wrapper_rshift_cycles_t, uint32_t>("rshift<uint32_t>", UINT32_C(0xFEDCBA98));
+    report_wrapper_cycles<wrapper_lshift_cycles_t, int32_t>("lshift<int32_t>", INT32_C(-19088744));
+    report_wrapper_cycles<wrapper_rshift_cycles_t, int32_t>("rshift<int32_t>", INT32_C(-19088744));
+#if defined(AFS_RUNTIME_API)
+    typedef wrapper_runtime_cycles_t<uint32_t> rt32_t;
+    report_wrapper_runtime_cycles<uint32_t, rt32_t::direct_lshift, rt32_t::wrapped_lshift>("lshift(uint32_t)", UINT32_C(0xFEDCBA98));
+    report_wrapper_runtime_cycles<uint32_t, rt32_t::direct_rshift, rt32_t::wrapped_rshift>("rshift(uint32_t)", UINT32_C(0xFEDCBA98));
+#endif
 #endif
 }
 
@@ -339,13 +2250,70 @@ void setup()
     delay(2000);
 #endif
 
+#if defined(AFS_USE_OPTIMIZED_SHIFTS)
+    cycle_timer_t::begin();
+#endif
+
     UNITY_BEGIN(); 
     RUN_TEST(test_LShift);
     RUN_TEST(test_RShift);
+    RUN_TEST(test_Shift64);
+    RUN_TEST(test_Shift24);
+    RUN_TEST(test_runtime_Shift24);
+    RUN_TEST(test_Rotate);
+    RUN_TEST(test_runtime_Rotate);
+    RUN_TEST(test_Bitfield);
+    RUN_TEST(test_NarrowingRShift);
+    RUN_TEST(test_WideningLShift);
+    RUN_TEST(test_MulShr);
+    RUN_TEST(test_Fixed);
+    RUN_TEST(test_FastInt);
+    RUN_TEST(test_RShiftRound);
+    RUN_TEST(test_LShiftSat);
+    RUN_TEST(test_ShiftCarry);
+    RUN_TEST(test_ShiftN);
+    RUN_TEST(test_MemoryShift);
+    RUN_TEST(test_AtomicShift);
+    RUN_TEST(test_Clz);
+    RUN_TEST(test_constant_folding);
     RUN_TEST(test_rshift_perf);
+    RUN_TEST(test_signed_rshift_perf);
     RUN_TEST(test_lshift_perf);
+    RUN_TEST(test_register_pressure_perf);
+    RUN_TEST(test_rshift64_perf);
+    RUN_TEST(test_signed_rshift64_perf);
+    RUN_TEST(test_lshift64_perf);
+    RUN_TEST(test_rshift16_perf);
+    RUN_TEST(test_signed_rshift16_perf);
+    RUN_TEST(test_lshift16_perf);
+    RUN_TEST(test_rotl_perf);
+    RUN_TEST(test_rotl16_perf);
+    RUN_TEST(test_extract_perf);
+    RUN_TEST(test_narrowing_rshift_perf);
+    RUN_TEST(test_widening_lshift_perf);
+    RUN_TEST(test_mul_shr_perf);
+    RUN_TEST(test_fixed_mul_perf);
+    RUN_TEST(test_rshift_round_perf);
+    RUN_TEST(test_lshift_sat_perf);
+    RUN_TEST(test_shift_array_perf);
+    RUN_TEST(test_shift_n_perf);
+    RUN_TEST(test_clz_perf);
+    RUN_TEST(test_rshift24_perf);
+    RUN_TEST(test_signed_rshift24_perf);
+    RUN_TEST(test_lshift24_perf);
     RUN_TEST(test_runtime_rshift_perf);
     RUN_TEST(test_runtime_lshift_perf);
+    RUN_TEST(test_runtime_mul_shift_perf);
+    RUN_TEST(test_runtime_shift24_perf);
+    RUN_TEST(test_cycles32);
+    RUN_TEST(test_cycles16);
+    RUN_TEST(test_cycles24);
+    RUN_TEST(test_cycles64);
+    RUN_TEST(test_memory_cycles);
+    RUN_TEST(test_atomic_cycles);
+    RUN_TEST(test_runtime_cycles);
+    RUN_TEST(test_wrapper_cycles);
+    RUN_TEST(test_size_optimized);
     UNITY_END(); 
 
     // Tell SimAVR we are done
@@ -1,4 +1,5 @@
 #pragma once
+#include <stdio.h>
 #include <unity.h>
 #include "timer.hpp"
 
@@ -9,3 +10,28 @@ static inline void MESSAGE_TIMERS(const simple_timer_t &timerA, const simple_tim
 
     TEST_PRINTF("Timing: %lu, %lu, %lu%%", aTime, bTime, percent);
 }
+
+static inline void MESSAGE_CYCLES(const char *label, const uint16_t *pCycles, uint8_t count) {
+    char szMsg[400];
+    int length = snprintf(szMsg, sizeof(szMsg), "%s:", label);
+    for (uint8_t index=0; index<count && length>0 && (size_t)length<sizeof(szMsg); ++index) {
+        length += snprintf(szMsg+length, sizeof(szMsg)-(size_t)length, " %u", pCycles[index]);
+    }
+    TEST_MESSAGE(szMsg);
+}
+
+static inline void MESSAGE_THROUGHPUT(const char *label, uint16_t cycles, uint16_t bytes) {
+    // Hundredths of a byte per cycle: printf on AVR has no floating point
+    uint16_t throughput = (uint16_t)((uint32_t)bytes * 100U / cycles);
+    TEST_PRINTF("%s: %u cycles for %u bytes, %u.%02u bytes/cycle", label, cycles, bytes, throughput/100U, throughput%100U);
+}
+
+// One "BENCH,<operation>,<implementation>,<distance>,<cycles>" line per distance,
+// for tools/bench_compare.py
+static inline void MESSAGE_BENCH(const char *operation, const char *implementation, const uint16_t *pCycles, uint8_t count, uint8_t firstDistance) {
+    char szMsg[96];
+    for (uint8_t index=0; index<count; ++index) {
+        snprintf(szMsg, sizeof(szMsg), "BENCH,%s,%s,%u,%u", operation, implementation, (unsigned)(firstDistance+index), pCycles[index]);
+        TEST_MESSAGE(szMsg);
+    }
+}
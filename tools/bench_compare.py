@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""Check the cycle counts reported by the unit tests when built with AFS_BENCH_CSV.
+
+Reads "pio test" output (a file or stdin) and fails if:
+  * any optimized shift takes more cycles than the native operator at the same distance
+    (unless --no-native)
+  * any optimized shift takes more cycles than recorded in the baseline for the environment
+    (if there is one: otherwise a warning is printed)
+
+E.g.
+    pio test -e megaatmega2560-O3-bench-sim | tee bench_output.txt
+    python tools/bench_compare.py --env O3 --baseline tools/bench_baseline.csv bench_output.txt
+
+Use --update to write the new results into the baseline instead.
+
+Use --no-native for unoptimized (-O0) builds: the wrappers aren't inlined there, so
+each optimized shift pays for calls that the native operator doesn't. The results
+are still tracked against the baseline.
+"""
+
+import argparse
+import csv
+import os
+import re
+import sys
+
+BENCH_LINE = re.compile(r'BENCH,([^,\s]+),(native|optimized),(\d+),(\d+)')
+FIELDS = ['env', 'operation', 'implementation', 'distance', 'cycles']
+
+
+def parse_results(lines):
+    """Map (operation, implementation, distance) -> cycles"""
+    results = {}
+    for line in lines:
+        match = BENCH_LINE.search(line)
+        if match:
+            operation, implementation, distance, cycles = match.groups()
+            results[(operation, implementation, int(distance))] = int(cycles)
+    return results
+
+
+def load_baseline(path):
+    """Map env -> {(operation, implementation, distance) -> cycles}"""
+    baseline = {}
+    if os.path.exists(path):
+        with open(path, newline='') as baseline_file:
+            for row in csv.DictReader(baseline_file):
+                key = (row['operation'], row['implementation'], int(row['distance']))
+                baseline.setdefault(row['env'], {})[key] = int(row['cycles'])
+    return baseline
+
+
+def save_baseline(path, baseline):
+    with open(path, 'w', newline='') as baseline_file:
+        writer = csv.writer(baseline_file, lineterminator='\n')
+        writer.writerow(FIELDS)
+        for env in sorted(baseline):
+            for (operation, implementation, distance), cycles in sorted(baseline[env].items()):
+                writer.writerow([env, operation, implementation, distance, cycles])
+
+
+def check_native(results):
+    failures = []
+    for (operation, implementation, distance), cycles in sorted(results.items()):
+        if implementation != 'optimized':
+            continue
+        native = results.get((operation, 'native', distance))
+        if native is not None and cycles > native:
+            failures.append('%s distance %d: %d cycles, native is %d' % (operation, distance, cycles, native))
+    return failures
+
+
+def check_baseline(results, baseline, tolerance):
+    failures = []
+    for key, cycles in sorted(results.items()):
+        operation, implementation, distance = key
+        expected = baseline.get(key)
+        if implementation == 'optimized' and expected is not None and cycles > expected + tolerance:
+            failures.append('%s distance %d: %d cycles, baseline is %d' % (operation, distance, cycles, expected))
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('input', nargs='?', type=argparse.FileType('r'), default=sys.stdin,
+                        help='"pio test" output (default: stdin)')
+    parser.add_argument('--env', required=True, help='baseline key, E.g. the optimization level')
+    parser.add_argument('--baseline', default=os.path.join(os.path.dirname(__file__), 'bench_baseline.csv'))
+    parser.add_argument('--tolerance', type=int, default=0, help='cycles allowed over the baseline')
+    parser.add_argument('--update', action='store_true', help='record the results as the new baseline')
+    parser.add_argument('--no-native', action='store_true', help="don't compare against the native operators")
+    args = parser.parse_args()
+
+    results = parse_results(args.input)
+    if not results:
+        print('No BENCH results found: was the firmware built with AFS_BENCH_CSV?')
+        return 1
+
+    baseline = load_baseline(args.baseline)
+    if args.update:
+        baseline[args.env] = results
+        save_baseline(args.baseline, baseline)
+        print('Baseline for %s updated: %d results' % (args.env, len(results)))
+        return 0
+
+    failures = [] if args.no_native else check_native(results)
+    if args.env in baseline:
+        failures += check_baseline(results, baseline[args.env], args.tolerance)
+    else:
+        print('WARNING no baseline for %s in %s: record one with --update' % (args.env, args.baseline))
+
+    for failure in failures:
+        print('FAIL ' + failure)
+    print('%s: %d results, %d failures' % (args.env, len(results), len(failures)))
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())